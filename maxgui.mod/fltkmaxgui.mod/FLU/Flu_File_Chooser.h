@@ -32,6 +32,7 @@
 #include "FLU/flu_export.h"
 #include "FLU/FluSimpleString.h"
 #include "FLU/FluVectorClass.h"
+#include "FLU/Flu_Thumbnail_Loader.h"
 
 FluMakeVectorClass( FluSimpleString, FluStringVector );
 
@@ -196,6 +197,15 @@ class FLU_EXPORT Flu_File_Chooser : public Fl_Double_Window
   inline void default_file_icon( Fl_Image* i )
     { defaultFileIcon = i; }
 
+  //! Set whether image files are shown with a small thumbnail instead of the icon for their type. Default is \c false
+  /*! The thumbnails are made in the background by Flu_Thumbnail_Loader::get(), and so is the preview */
+  inline void thumbnails( bool b )
+    { iconThumbnails = b; }
+
+  //! Get whether image files are shown with a small thumbnail instead of the icon for their type
+  inline bool thumbnails() const
+    { return iconThumbnails; }
+
   //! Alias for cd()
   inline void directory( const char *d )
     { cd( d ); }
@@ -414,6 +424,7 @@ class FLU_EXPORT Flu_File_Chooser : public Fl_Double_Window
 
       void updateSize();
       void updateIcon();
+      void updateInfo( unsigned long size, time_t mtime );
 
       FluSimpleString filename, date, filesize, shortname, 
 	description, shortDescription, toolTip, altname;
@@ -425,6 +436,8 @@ class FLU_EXPORT Flu_File_Chooser : public Fl_Double_Window
       int editMode;
       Flu_File_Chooser *chooser;
       Fl_Image *icon;
+      Fl_RGB_Image *thumb; // thumbnail used as the icon, from the thumbnail loader
+      bool pending;        // waiting for the thumbnail loader
 
       int nameW, typeW, sizeW, dateW;
       bool details;
@@ -436,6 +449,10 @@ class FLU_EXPORT Flu_File_Chooser : public Fl_Double_Window
       inline static void _editCB( void *arg )
 	{ ((Entry*)arg)->editCB(); }
       void editCB();
+
+      inline static void _infoCB( const Flu_Thumbnail_Loader::Info &info, void *arg )
+	{ ((Entry*)arg)->infoCB( info ); }
+      void infoCB( const Flu_Thumbnail_Loader::Info &info );
     };
 
   friend class FileList;
@@ -511,8 +528,16 @@ class FLU_EXPORT Flu_File_Chooser : public Fl_Double_Window
   class ImgTxtPreview : public PreviewWidgetBase
     {
     public:
+      ImgTxtPreview();
       int preview( const char *filename );
+      void clearImage();
       unsigned char previewTxt[1024];
+      Fl_RGB_Image *thumb; // image() when it came from the thumbnail loader
+      Fl_Widget *target;   // preview group waiting for the thumbnail
+
+      inline static void _thumbnailCB( const Flu_Thumbnail_Loader::Info &info, void *arg )
+	{ ((ImgTxtPreview*)arg)->thumbnailCB( info ); }
+      void thumbnailCB( const Flu_Thumbnail_Loader::Info &info );
     };
 
   friend class PreviewGroup;
@@ -579,8 +604,9 @@ class FLU_EXPORT Flu_File_Chooser : public Fl_Double_Window
   Fl_Browser *favoritesList;
   Flu_Combo_List *filePattern;
   int selectionType;
-  bool filenameEnterCallback, filenameTabCallback, walkingHistory, caseSort, fileEditing;
+  bool filenameEnterCallback, filenameTabCallback, walkingHistory, caseSort, fileEditing, iconThumbnails;
   int sortMethod;
+  int pendingInfo; // entries still waiting for their size and date
 
   FluStringVector patterns;
 
@@ -0,0 +1,132 @@
+// $Id: Flu_Thumbnail_Loader.h,v 1.1 2004/11/02 00:33:31 jbryan Exp $
+
+/***************************************************************
+ *                FLU - FLTK Utility Widgets
+ *  Copyright (C) 2002 Ohio Supercomputer Center, Ohio State University
+ *
+ * This file and its content is protected by a software license.
+ * You should have received a copy of this license with this file.
+ * If not, please contact the Ohio Supercomputer Center immediately:
+ * Attn: Jason Bryan Re: FLU 1224 Kinnear Rd, Columbus, Ohio 43212
+ *
+ ***************************************************************/
+
+
+
+#ifndef _FLU_THUMBNAIL_LOADER_H
+#define _FLU_THUMBNAIL_LOADER_H
+
+#include <time.h>
+
+/* fltk includes */
+#include <FL/Fl.H>
+#include <FL/Fl_Image.H>
+
+#include "FLU/Flu_Enumerations.h"
+#include "FLU/FluSimpleString.h"
+
+//! This class reads file information and makes thumbnails of image files on a background thread
+/*! Flu_File_Chooser uses it so that large directories and large images never block the dialog:
+  the list is shown immediately and the sizes, dates and thumbnails fill in as they arrive.
+
+  Every request() is answered exactly once, on the main thread, by calling the given callback
+  with an Info describing the file, unless it is cancel()ed first. Results are handed over with
+  Fl::awake(), so like any threaded FLTK program the application must call Fl::lock() once before
+  its event loop.
+
+  Thumbnails are kept in a memory cache with a size limit, least recently used first out, and
+  optionally in a directory on disk, where they are found again as long as the path, size and
+  modification time of the file are unchanged.
+
+  There is a single loader, shared by everything in the program, returned by get().
+*/
+class FLU_EXPORT Flu_Thumbnail_Loader
+{
+
+ public:
+
+  //! What the loader found out about a file
+  struct Info
+  {
+    //! The path that was passed to request()
+    const char *path;
+    //! \c false if the file could not be stat'ed, in which case the other fields are zero
+    bool exists;
+    bool isDir;
+    unsigned long size;
+    time_t mtime;
+    //! The thumbnail, or \c NULL if none was asked for or the file could not be decoded.
+    /*! The receiver owns one reference to it and must give it back with release() */
+    Fl_RGB_Image *image;
+  };
+
+  //! The type of function called with the result of a request()
+  typedef void Callback( const Info &info, void *arg );
+
+  //! \return the loader, creating it the first time
+  static Flu_Thumbnail_Loader* get();
+
+  //! Ask for the information about file \b path, and a thumbnail of at most \b w x \b h pixels if \b w and \b h are nonzero
+  /*! \b cb is called with \b arg when the result is ready. \b owner is any pointer that cancel() can later
+    use to drop all the requests it made. \b urgent requests are served before all others. */
+  void request( const char *path, int w, int h, Callback *cb, void *arg, void *owner = 0, bool urgent = false );
+
+  //! Drop all the pending requests whose \b arg or \b owner is \b p. Their callbacks will not be called
+  void cancel( void *p );
+
+  //! Give back a reference to a thumbnail passed to a callback
+  void release( Fl_RGB_Image *image );
+
+  //! \return \c true if thumbnails can be made of the file named \b path, judging by its extension
+  static bool can_decode( const char *path );
+
+  //! Set the number of bytes of thumbnail pixels kept in memory. Default is 32MB
+  void memory_limit( unsigned long bytes );
+
+  //! Get the number of bytes of thumbnail pixels kept in memory
+  inline unsigned long memory_limit() const
+    { return maxBytes; }
+
+  //! Set the directory in which thumbnails are also saved, so they survive the program. \c NULL (the default) turns this off
+  void disk_cache( const char *dir );
+
+ private:
+
+  class Thumb;
+  struct Job;
+  struct Sys;
+
+  Flu_Thumbnail_Loader();
+
+  void start();
+  void loop();
+  void run( Job *job );
+  Thumb* find( const FluSimpleString &path, int w, int h, unsigned long size, time_t mtime );
+  void insert( Thumb *t );
+  void remove( Thumb *t );
+  void touch( Thumb *t );
+  void trim();
+  Fl_RGB_Image* decode( const char *path, int w, int h );
+  Fl_RGB_Image* read_disk( const FluSimpleString &dir, const FluSimpleString &key );
+  void write_disk( const FluSimpleString &dir, const FluSimpleString &key, Fl_RGB_Image *img );
+  FluSimpleString disk_name( const FluSimpleString &key );
+
+  static void deliverCB( void *arg );
+
+  Sys *sys;
+  Job *first, *last;   // pending requests
+  Job *done, *doneLast; // results waiting for the main thread
+  Job *current;         // request the worker is on
+  bool posted;         // deliverCB() is queued with Fl::awake()
+
+  enum { HASH_SIZE = 1024 };
+  Thumb *hash[HASH_SIZE];
+  Thumb *recent, *oldest; // memory cache, most recently used first
+  unsigned long bytes, maxBytes;
+  FluSimpleString diskDir;
+
+  static Flu_Thumbnail_Loader *loader;
+
+};
+
+#endif
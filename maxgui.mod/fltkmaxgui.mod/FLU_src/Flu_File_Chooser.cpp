@@ -104,6 +104,8 @@ FluSimpleString Flu_File_Chooser::renameErrTxt = "Unable to rename '%s' to '%s'"
 #define FAVORITES_UNIQUE_STRING   "\t!@#$%^&*(Favorites)-=+"
 
 #define DEFAULT_ENTRY_WIDTH 235
+// largest thumbnail that fits an entry in place of its icon
+#define THUMBNAIL_ICON_SIZE 18
 
 Fl_Pixmap up_folder_img( (char*const*)big_folder_up_xpm ),
   trash( (char*const*)trash_xpm ),
@@ -408,6 +410,8 @@ Flu_File_Chooser :: Flu_File_Chooser( const char *pathname, const char *pat, int
   history = currentHist = NULL;
   walkingHistory = false;
   fileEditing = false;
+  iconThumbnails = false;
+  pendingInfo = 0;
 #ifdef WIN32
   refreshDrives = true;
   caseSort = false;
@@ -806,6 +810,13 @@ Flu_File_Chooser :: ~Flu_File_Chooser()
   Fl::remove_timeout( Flu_File_Chooser::delayedCdCB );
   Fl::remove_timeout( Flu_File_Chooser::selectCB );
 
+  Flu_Thumbnail_Loader::get()->cancel( this );
+  if( imgTxtPreview->target == previewGroup )
+    {
+      Flu_Thumbnail_Loader::get()->cancel( imgTxtPreview );
+      imgTxtPreview->target = NULL;
+    }
+
   for( int i = 0; i < locationQuickJump->children(); i++ )
     free( (void*)locationQuickJump->child(i)->label() );
 
@@ -1458,6 +1469,45 @@ void Flu_File_Chooser :: PreviewGroup :: draw()
     }
 }
 
+Flu_File_Chooser :: ImgTxtPreview :: ImgTxtPreview()
+{
+  thumb = NULL;
+  target = NULL;
+}
+
+void Flu_File_Chooser :: ImgTxtPreview :: clearImage()
+{
+  if( image() && image() == thumb )
+    Flu_Thumbnail_Loader::get()->release( thumb );
+  else if( image() )
+    ((Fl_Shared_Image*)image())->release();
+  thumb = NULL;
+  image(0);
+}
+
+void Flu_File_Chooser :: ImgTxtPreview :: thumbnailCB( const Flu_Thumbnail_Loader::Info &info )
+{
+  clearImage();
+  if( info.image )
+    {
+      thumb = info.image;
+      image( thumb );
+      label(0);
+    }
+  else
+    {
+      // not a readable image after all
+      align( FL_ALIGN_CENTER | FL_ALIGN_CLIP );
+      labelsize( 60 );
+      labelfont( FL_HELVETICA );
+      label( "?" );
+    }
+  redraw();
+  if( target )
+    target->redraw();
+  target = NULL;
+}
+
 // adapted from Fl_File_Chooser2.cxx : update_preview()
 int Flu_File_Chooser :: ImgTxtPreview ::  preview( const char *filename )
 {
@@ -1466,6 +1516,27 @@ int Flu_File_Chooser :: ImgTxtPreview ::  preview( const char *filename )
   int			pbw, pbh;	// Width and height of preview box
   int			w, h;		// Width and height of preview image
 
+  Flu_Thumbnail_Loader::get()->cancel( this );
+  target = NULL;
+  clearImage();
+
+  pbw = this->w() - 20;
+  pbh = this->h() - 20;
+  pbw = (pbw < 10) ? 10 : pbw;
+  pbh = (pbh < 10) ? 10 : pbh;
+
+  // images the thumbnail loader can read are decoded and scaled in the
+  // background, so that a large photo does not stop the dialog
+  if( Flu_Thumbnail_Loader::can_decode( filename ) )
+    {
+      // the preview group is our parent while it asks us
+      target = parent();
+      align( FL_ALIGN_CLIP );
+      label(0);
+      Flu_Thumbnail_Loader::get()->request( filename, pbw, pbh, _thumbnailCB, this, this, true );
+      return 1;
+    }
+
   window()->cursor( FL_CURSOR_WAIT );
   Fl::check();
 
@@ -1476,11 +1547,6 @@ int Flu_File_Chooser :: ImgTxtPreview ::  preview( const char *filename )
       Fl::check();
     }
 
-  oldimg = (Fl_Shared_Image*)image();
-  if( oldimg )
-    oldimg->release();
-  image(0);
-
   if( !img )
     {
       // Try reading the first 1k of data for a label...
@@ -1517,12 +1583,6 @@ int Flu_File_Chooser :: ImgTxtPreview ::  preview( const char *filename )
     }
   else if( img->w() > 0 && img->h() > 0 )
     {
-
-      pbw = this->w() - 20;
-      pbh = this->h() - 20;
-      pbw = (pbw < 10) ? 10 : pbw;
-      pbh = (pbh < 10) ? 10 : pbh;
-
       if( img->w() > pbw || img->h() > pbh )
 	{
 	  w = pbw;
@@ -2205,6 +2265,8 @@ Flu_File_Chooser :: Entry :: Entry( const char* name, int t, bool d, Flu_File_Ch
   details = d;
   type = t;
   icon = NULL;
+  thumb = NULL;
+  pending = false;
   editMode = 0;
   description = "";
 
@@ -2258,6 +2320,8 @@ void Flu_File_Chooser :: Entry :: updateIcon()
     icon = chooser->defaultFileIcon;
   if( type==ENTRY_FAVORITE )
     icon = &little_favorites;
+  if( thumb )
+    icon = thumb;
 
   toolTip = detailTxt[0] + ": " + filename;
   if( type == ENTRY_FILE )
@@ -2401,6 +2465,71 @@ void Flu_File_Chooser :: Entry :: updateSize()
 
 Flu_File_Chooser :: Entry :: ~Entry()
 {
+  if( pending )
+    Flu_Thumbnail_Loader::get()->cancel( this );
+  if( thumb )
+    Flu_Thumbnail_Loader::get()->release( thumb );
+}
+
+void Flu_File_Chooser :: Entry :: infoCB( const Flu_Thumbnail_Loader::Info &info )
+{
+  pending = false;
+  if( info.exists )
+    updateInfo( info.size, info.mtime );
+  if( info.image )
+    thumb = info.image;
+  updateIcon();
+
+  // once every size and date is in, put them in order if that is how they are sorted
+  if( --chooser->pendingInfo == 0 && ( chooser->sortMethod & ( SORT_SIZE | SORT_DATE ) ) )
+    {
+      chooser->filelist->sort();
+      chooser->filedetails->sort();
+    }
+}
+
+void Flu_File_Chooser :: Entry :: updateInfo( unsigned long size, time_t mtime )
+{
+  // store size as human readable and sortable integer
+  isize = size;
+  if( type == ENTRY_DIR && isize == 0 )
+    filesize = "";
+  else
+    {
+      char buf[32];
+      /*
+	if( (isize >> 40) > 0 ) // terrabytes
+	{
+	double TB = double(isize)/double(1<<40);
+	sprintf( buf, "%.1f TB", TB );
+	}
+      */
+      if( (isize >> 30) > 0 ) // gigabytes
+	{
+	  double GB = double(isize)/double(1<<30);
+	  sprintf( buf, "%.1f GB", GB );
+	}
+      else if( (isize >> 20) > 0 ) // megabytes
+	{
+	  double MB = double(isize)/double(1<<20);
+	  sprintf( buf, "%.1f MB", MB );
+	}
+      else if( (isize >> 10) > 0 ) // kilabytes
+	{
+	  double KB = double(isize)/double(1<<10);
+	  sprintf( buf, "%.1f KB", KB );
+	}
+      else // bytes
+	{
+	  sprintf( buf, "%d bytes", (int)isize );
+	}
+      filesize = buf;
+    }
+
+  // store date as human readable and sortable integer
+  date = chooser->formatDate( ctime( &mtime ) );
+  idate = mtime;
+  redraw();
 }
 
 void Flu_File_Chooser :: Entry :: inputCB()
@@ -3564,6 +3693,8 @@ void Flu_File_Chooser :: cd( const char *path )
       location->input.value( favoritesTxt.c_str() );
       updateLocationQJ();
 
+      Flu_Thumbnail_Loader::get()->cancel( this );
+      pendingInfo = 0;
       filelist->clear();
       filedetails->clear();
       if( listMode )
@@ -3649,6 +3780,8 @@ void Flu_File_Chooser :: cd( const char *path )
     }
 
   int numDirs = 0, numFiles = 0;
+  Flu_Thumbnail_Loader::get()->cancel( this );
+  pendingInfo = 0;
   filelist->clear();
   filedetails->clear();
 
@@ -3861,13 +3994,12 @@ void Flu_File_Chooser :: cd( const char *path )
 	      strcmp( name, ".\\" ) == 0 || strcmp( name, "..\\" ) == 0 )
 	    continue;
 
-	  // if 'name' ends in '/', remove it
-	  if( name[strlen(name)-1] == '/' )
+	  // fl_filename_list() already marked the directories with a trailing '/'. remove it
+	  isDir = ( name[strlen(name)-1] == '/' );
+	  if( isDir )
 	    name[strlen(name)-1] = '\0';
 
-	  // file or directory?
 	  fullpath = pathbase + name;
-	  isDir = ( fl_filename_isdir( fullpath.c_str() ) != 0 );
 
 	  // was this file specified explicitly?
 	  isCurrentFile = ( currentFile == name );
@@ -3948,61 +4080,12 @@ void Flu_File_Chooser :: cd( const char *path )
 	      lastAddedFile = entry->filename.c_str();
 	    }
 
-	  // get some information about the file
-	  struct stat s;
-	  ::stat( fullpath.c_str(), &s );
-
-	  // store size as human readable and sortable integer
-	  entry->isize = s.st_size;
-	  if( isDir && entry->isize == 0 )
-	    entry->filesize = "";
-	  else
-	    {
-	      char buf[32];
-	      /*
-		if( (entry->isize >> 40) > 0 ) // terrabytes
-		{
-		double TB = double(entry->isize)/double(1<<40);
-		sprintf( buf, "%.1f TB", TB );
-		}
-	      */
-	      if( (entry->isize >> 30) > 0 ) // gigabytes
-		{
-		  double GB = double(entry->isize)/double(1<<30);
-		  sprintf( buf, "%.1f GB", GB );
-		}
-	      else if( (entry->isize >> 20) > 0 ) // megabytes
-		{
-		  double MB = double(entry->isize)/double(1<<20);
-		  sprintf( buf, "%.1f MB", MB );
-		}
-	      else if( (entry->isize >> 10) > 0 ) // kilabytes
-		{
-		  double KB = double(entry->isize)/double(1<<10);
-		  sprintf( buf, "%.1f KB", KB );
-		}
-	      else // bytes
-		{
-		  sprintf( buf, "%d bytes", (int)entry->isize );
-		}
-	      entry->filesize = buf;
-	    }
-
-	  // store date as human readable and sortable integer
-	  entry->date = formatDate( ctime( &s.st_mtime ) );//ctime( &s.st_mtime );
-	  entry->idate = s.st_mtime;
-
-	  // convert the permissions into UNIX style rwx-rwx-rwx (user-group-others)
-	  /*
-	    unsigned int p = s.st_mode;
-	    entry->pU = bool(p&S_IRUSR)<<2 | bool(p&S_IWUSR)<<1 | bool(p&S_IXUSR);
-	    entry->pG = bool(p&S_IRGRP)<<2 | bool(p&S_IWGRP)<<1 | bool(p&S_IXGRP);
-	    entry->pO = bool(p&S_IROTH)<<2 | bool(p&S_IWOTH)<<1 | bool(p&S_IXOTH);
-	    char* perms[8] = { "---", "--x", "-w-", "-wx", "r--", "r-x", "rw-", "rwx" };
-	    entry->permissions = perms[entry->pU];
-	    entry->permissions += perms[entry->pG];
-	    entry->permissions += perms[entry->pO];
-	  */
+	  // the size and date, and the thumbnail if one is wanted, are filled in
+	  // by the thumbnail loader as they arrive
+	  int thumbSize = ( iconThumbnails && !isDir ) ? THUMBNAIL_ICON_SIZE : 0;
+	  entry->pending = true;
+	  pendingInfo++;
+	  Flu_Thumbnail_Loader::get()->request( fullpath.c_str(), thumbSize, thumbSize, Entry::_infoCB, entry, this );
 
 	  entry->updateSize();
 	  entry->updateIcon();
@@ -0,0 +1,607 @@
+// $Id: Flu_Thumbnail_Loader.cpp,v 1.1 2004/11/02 00:33:31 jbryan Exp $
+
+/***************************************************************
+ *                FLU - FLTK Utility Widgets
+ *  Copyright (C) 2002 Ohio Supercomputer Center, Ohio State University
+ *
+ * This file and its content is protected by a software license.
+ * You should have received a copy of this license with this file.
+ * If not, please contact the Ohio Supercomputer Center immediately:
+ * Attn: Jason Bryan Re: FLU 1224 Kinnear Rd, Columbus, Ohio 43212
+ *
+ ***************************************************************/
+
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include <config.h>
+#include <FL/Fl.H>
+#include <FL/filename.H>
+#include <FL/fl_utf8.h>
+#include <FL/Fl_Image_Decoder.H>
+
+#include "FLU/Flu_Thumbnail_Loader.h"
+
+// bytes of thumbnail pixels kept in memory when nobody is using them
+#define DEFAULT_MEMORY_LIMIT (32<<20)
+
+// the largest thumbnail accepted from the disk cache
+#define MAX_THUMBNAIL_SIZE 4096
+
+Flu_Thumbnail_Loader* Flu_Thumbnail_Loader::loader = 0;
+
+// a cached thumbnail. it owns the pixels it took over from the decoded image
+class Flu_Thumbnail_Loader::Thumb : public Fl_RGB_Image
+{
+public:
+  Thumb( Fl_RGB_Image *img )
+    : Fl_RGB_Image( img->array, img->w(), img->h(), img->d(), img->ld() )
+    {
+      alloc_array = img->alloc_array;
+      img->alloc_array = 0;
+      refs = 0;
+      prev = next = chain = NULL;
+    }
+
+  FluSimpleString path;
+  int tw, th;
+  unsigned long fsize;
+  time_t mtime;
+  int refs;
+  Thumb *prev, *next, *chain;
+};
+
+struct Flu_Thumbnail_Loader::Job
+{
+  FluSimpleString path;
+  int w, h;
+  Callback *cb;
+  void *arg, *owner;
+  bool cancelled;
+  Info info;
+  Thumb *thumb;
+  Job *next;
+};
+
+// the thread, its lock and the decoder it reuses for every image
+struct Flu_Thumbnail_Loader::Sys
+{
+#ifdef WIN32
+  CRITICAL_SECTION mutex;
+  HANDLE wake;
+  HANDLE thread;
+
+  Sys() { InitializeCriticalSection( &mutex ); wake = CreateEvent( NULL, FALSE, FALSE, NULL ); thread = NULL; }
+  inline void lock() { EnterCriticalSection( &mutex ); }
+  inline void unlock() { LeaveCriticalSection( &mutex ); }
+  inline void signal() { SetEvent( wake ); }
+  inline void wait() { unlock(); WaitForSingleObject( wake, INFINITE ); lock(); }
+  inline void pause() { unlock(); Sleep( 10 ); lock(); }
+
+  static unsigned __stdcall entry( void *arg )
+    { ((Flu_Thumbnail_Loader*)arg)->loop(); return 0; }
+  inline bool create( Flu_Thumbnail_Loader *l )
+    { thread = (HANDLE)_beginthreadex( NULL, 0, entry, l, 0, NULL ); return thread != NULL; }
+#else
+  pthread_mutex_t mutex;
+  pthread_cond_t wake;
+  pthread_t thread;
+
+  Sys() { pthread_mutex_init( &mutex, NULL ); pthread_cond_init( &wake, NULL ); }
+  inline void lock() { pthread_mutex_lock( &mutex ); }
+  inline void unlock() { pthread_mutex_unlock( &mutex ); }
+  inline void signal() { pthread_cond_signal( &wake ); }
+  inline void wait() { pthread_cond_wait( &wake, &mutex ); }
+  inline void pause() { unlock(); usleep( 10000 ); lock(); }
+
+  static void* entry( void *arg )
+    { ((Flu_Thumbnail_Loader*)arg)->loop(); return NULL; }
+  inline bool create( Flu_Thumbnail_Loader *l )
+    { return pthread_create( &thread, NULL, entry, l ) == 0; }
+#endif
+
+  bool started;
+  Fl_Image_Decoder decoder;
+};
+
+static unsigned int hash_string( const char *s, unsigned int h = 2166136261u )
+{
+  // FNV-1a
+  for( ; *s; s++ )
+    h = ( h ^ (unsigned char)*s ) * 16777619u;
+  return h;
+}
+
+static const char* image_type( const char *path )
+{
+  const char *ext = fl_filename_ext( path );
+  if( !*ext )
+    return NULL;
+  char e[6];
+  int i;
+  for( i = 0; i < 5 && ext[i+1]; i++ )
+    e[i] = tolower( ext[i+1] );
+  if( ext[i+1] )
+    return NULL;
+  e[i] = '\0';
+  // only the formats Fl_Image_Decoder was built with, the others are left
+  // to the old previews
+#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
+  if( strcmp( e, "png" ) == 0 )
+    return "png";
+#endif
+#ifdef HAVE_LIBJPEG
+  if( strcmp( e, "jpg" ) == 0 || strcmp( e, "jpeg" ) == 0 || strcmp( e, "jpe" ) == 0 )
+    return "jpeg";
+#endif
+  return NULL;
+}
+
+Flu_Thumbnail_Loader* Flu_Thumbnail_Loader :: get()
+{
+  if( !loader )
+    loader = new Flu_Thumbnail_Loader();
+  return loader;
+}
+
+Flu_Thumbnail_Loader :: Flu_Thumbnail_Loader()
+{
+  sys = new Sys;
+  sys->started = false;
+  first = last = done = doneLast = current = NULL;
+  posted = false;
+  memset( hash, 0, sizeof(hash) );
+  recent = oldest = NULL;
+  bytes = 0;
+  maxBytes = DEFAULT_MEMORY_LIMIT;
+}
+
+bool Flu_Thumbnail_Loader :: can_decode( const char *path )
+{
+  return image_type( path ) != NULL;
+}
+
+void Flu_Thumbnail_Loader :: memory_limit( unsigned long b )
+{
+  maxBytes = b;
+  trim();
+}
+
+void Flu_Thumbnail_Loader :: disk_cache( const char *dir )
+{
+  sys->lock();
+  diskDir = dir ? dir : "";
+  if( diskDir.size() && diskDir[diskDir.size()-1] != '/' )
+    diskDir += "/";
+  sys->unlock();
+  if( dir )
+    fl_make_path( dir );
+}
+
+void Flu_Thumbnail_Loader :: start()
+{
+  if( sys->started )
+    return;
+  sys->started = sys->create( this );
+}
+
+void Flu_Thumbnail_Loader :: request( const char *path, int w, int h, Callback *cb, void *arg, void *owner, bool urgent )
+{
+  Job *j = new Job;
+  j->path = path;
+  j->w = w;
+  j->h = h;
+  j->cb = cb;
+  j->arg = arg;
+  j->owner = owner;
+  j->cancelled = false;
+  j->thumb = NULL;
+  j->next = NULL;
+  memset( &j->info, 0, sizeof(j->info) );
+
+  start();
+  if( !sys->started )
+    {
+      // no thread: do the work right away, which is what the caller did before
+      run( j );
+      j->info.path = j->path.c_str();
+      j->info.image = j->thumb;
+      j->cb( j->info, j->arg );
+      delete j;
+      trim();
+      return;
+    }
+
+  sys->lock();
+  if( urgent || !first )
+    {
+      j->next = first;
+      first = j;
+      if( !last )
+	last = j;
+    }
+  else
+    {
+      last->next = j;
+      last = j;
+    }
+  sys->signal();
+  sys->unlock();
+}
+
+void Flu_Thumbnail_Loader :: cancel( void *p )
+{
+  Job *dropped = NULL;
+  sys->lock();
+  Job **lists[2] = { &first, &done };
+  Job **tails[2] = { &last, &doneLast };
+  for( int i = 0; i < 2; i++ )
+    {
+      Job *prev = NULL;
+      for( Job *j = *lists[i], *next; j; j = next )
+	{
+	  next = j->next;
+	  if( j->arg == p || j->owner == p )
+	    {
+	      if( prev )
+		prev->next = next;
+	      else
+		*lists[i] = next;
+	      j->next = dropped;
+	      dropped = j;
+	    }
+	  else
+	    prev = j;
+	}
+      *tails[i] = prev;
+    }
+  if( current && ( current->arg == p || current->owner == p ) )
+    current->cancelled = true;
+  for( Job *j = dropped; j; j = j->next )
+    if( j->thumb )
+      j->thumb->refs--;
+  sys->unlock();
+
+  while( dropped )
+    {
+      Job *j = dropped;
+      dropped = j->next;
+      delete j;
+    }
+  trim();
+}
+
+void Flu_Thumbnail_Loader :: release( Fl_RGB_Image *image )
+{
+  if( !image )
+    return;
+  sys->lock();
+  ((Thumb*)image)->refs--;
+  sys->unlock();
+  trim();
+}
+
+void Flu_Thumbnail_Loader :: loop()
+{
+  sys->lock();
+  for(;;)
+    {
+      while( !first )
+	sys->wait();
+      Job *j = first;
+      first = j->next;
+      if( !first )
+	last = NULL;
+      current = j;
+      sys->unlock();
+
+      run( j );
+
+      sys->lock();
+      current = NULL;
+      if( j->cancelled )
+	{
+	  if( j->thumb )
+	    j->thumb->refs--;
+	  delete j;
+	  continue;
+	}
+      j->next = NULL;
+      if( doneLast )
+	doneLast->next = j;
+      else
+	done = j;
+      doneLast = j;
+      // if the message cannot be queued (out of memory), try again shortly,
+      // as nothing else would deliver the results
+      while( !posted )
+	{
+	  posted = ( Fl::awake( deliverCB, this ) == 0 );
+	  if( !posted )
+	    sys->pause();
+	}
+    }
+}
+
+void Flu_Thumbnail_Loader :: deliverCB( void *arg )
+{
+  Flu_Thumbnail_Loader *l = (Flu_Thumbnail_Loader*)arg;
+  // take the results one at a time, so that a callback may cancel() the ones still waiting
+  for(;;)
+    {
+      l->sys->lock();
+      Job *j = l->done;
+      if( !j )
+	{
+	  l->posted = false;
+	  l->sys->unlock();
+	  break;
+	}
+      l->done = j->next;
+      if( !l->done )
+	l->doneLast = NULL;
+      l->sys->unlock();
+
+      j->info.path = j->path.c_str();
+      j->info.image = j->thumb;
+      j->cb( j->info, j->arg );
+      delete j;
+    }
+  l->trim();
+}
+
+void Flu_Thumbnail_Loader :: run( Job *j )
+{
+  struct stat s;
+  if( fl_stat( j->path.c_str(), &s ) != 0 )
+    return;
+  j->info.exists = true;
+  j->info.isDir = ( s.st_mode & S_IFMT ) == S_IFDIR;
+  j->info.size = s.st_size;
+  j->info.mtime = s.st_mtime;
+
+  if( j->w <= 0 || j->h <= 0 || j->info.isDir || !can_decode( j->path.c_str() ) )
+    return;
+
+  sys->lock();
+  Thumb *t = find( j->path, j->w, j->h, j->info.size, j->info.mtime );
+  if( t )
+    {
+      t->refs++;
+      touch( t );
+    }
+  FluSimpleString dir = diskDir;
+  sys->unlock();
+  if( t )
+    {
+      j->thumb = t;
+      return;
+    }
+
+  // the disk cache is keyed by everything that makes a thumbnail stale
+  char buf[64];
+  sprintf( buf, "\n%lu\n%ld\n%dx%d", j->info.size, (long)j->info.mtime, j->w, j->h );
+  FluSimpleString key = j->path + buf;
+
+  Fl_RGB_Image *img = NULL;
+  if( dir.size() )
+    img = read_disk( dir, key );
+  if( !img )
+    {
+      img = decode( j->path.c_str(), j->w, j->h );
+      if( img && dir.size() )
+	write_disk( dir, key, img );
+    }
+  if( !img )
+    return;
+
+  t = new Thumb( img );
+  delete img;
+  t->path = j->path;
+  t->tw = j->w;
+  t->th = j->h;
+  t->fsize = j->info.size;
+  t->mtime = j->info.mtime;
+  t->refs = 1;
+
+  sys->lock();
+  insert( t );
+  sys->unlock();
+  j->thumb = t;
+}
+
+Fl_RGB_Image* Flu_Thumbnail_Loader :: decode( const char *path, int w, int h )
+{
+  // a JPEG is decoded straight to the smallest size that still covers the thumbnail
+  sys->decoder.max_size( w, h );
+  Fl_RGB_Image *img;
+  if( strcmp( image_type( path ), "png" ) == 0 )
+    img = sys->decoder.png( path );
+  else
+    img = sys->decoder.jpeg( path );
+  if( !img || ( img->w() <= w && img->h() <= h ) )
+    return img;
+
+  int W = w, H = img->h() * w / img->w();
+  if( H > h )
+    {
+      H = h;
+      W = img->w() * h / img->h();
+    }
+  if( W < 1 ) W = 1;
+  if( H < 1 ) H = 1;
+  Fl_RGB_Image *small = (Fl_RGB_Image*)img->copy( W, H, FL_RGB_SCALING_BILINEAR );
+  delete img;
+  return small;
+}
+
+FluSimpleString Flu_Thumbnail_Loader :: disk_name( const FluSimpleString &key )
+{
+  // two different hashes of the key make collisions unlikely; the key is also stored in the file
+  char buf[32];
+  sprintf( buf, "%08x%08x.thumb", hash_string( key.c_str() ), hash_string( key.c_str(), 0x01000193u ) );
+  return FluSimpleString( buf );
+}
+
+// a disk cache file holds "FLUT", the length of the key and the key, the width,
+// height and depth of the thumbnail, then its pixels
+Fl_RGB_Image* Flu_Thumbnail_Loader :: read_disk( const FluSimpleString &dir, const FluSimpleString &key )
+{
+  FILE *f = fl_fopen( ( dir + disk_name( key ) ).c_str(), "rb" );
+  if( !f )
+    return NULL;
+  Fl_RGB_Image *img = NULL;
+  char magic[4];
+  int len, hdr[3];
+  if( fread( magic, 1, 4, f ) == 4 && memcmp( magic, "FLUT", 4 ) == 0 &&
+      fread( &len, sizeof(int), 1, f ) == 1 && len == key.size() )
+    {
+      char *k = new char[len];
+      if( fread( k, 1, len, f ) == (size_t)len && memcmp( k, key.c_str(), len ) == 0 &&
+	  fread( hdr, sizeof(int), 3, f ) == 3 &&
+	  hdr[0] > 0 && hdr[0] <= MAX_THUMBNAIL_SIZE && hdr[1] > 0 && hdr[1] <= MAX_THUMBNAIL_SIZE &&
+	  hdr[2] >= 1 && hdr[2] <= 4 )
+	{
+	  size_t n = (size_t)hdr[0] * hdr[1] * hdr[2];
+	  uchar *pixels = new uchar[n];
+	  if( fread( pixels, 1, n, f ) == n )
+	    {
+	      img = new Fl_RGB_Image( pixels, hdr[0], hdr[1], hdr[2] );
+	      img->alloc_array = 1;
+	    }
+	  else
+	    delete[] pixels;
+	}
+      delete[] k;
+    }
+  fclose( f );
+  return img;
+}
+
+void Flu_Thumbnail_Loader :: write_disk( const FluSimpleString &dir, const FluSimpleString &key, Fl_RGB_Image *img )
+{
+  // write to a temporary file and rename it, so that a half written thumbnail is never read
+  FluSimpleString name = dir + disk_name( key ), tmp = name + ".tmp";
+  FILE *f = fl_fopen( tmp.c_str(), "wb" );
+  if( !f )
+    return;
+  int len = key.size();
+  int hdr[3] = { img->w(), img->h(), img->d() };
+  int ld = img->ld() ? img->ld() : img->w() * img->d();
+  bool ok = fwrite( "FLUT", 1, 4, f ) == 4 &&
+    fwrite( &len, sizeof(int), 1, f ) == 1 &&
+    fwrite( key.c_str(), 1, len, f ) == (size_t)len &&
+    fwrite( hdr, sizeof(int), 3, f ) == 3;
+  for( int y = 0; ok && y < img->h(); y++ )
+    ok = fwrite( img->array + y * ld, img->d(), img->w(), f ) == (size_t)img->w();
+  if( fclose( f ) != 0 )
+    ok = false;
+  if( ok )
+    {
+      fl_unlink( name.c_str() );
+      ok = fl_rename( tmp.c_str(), name.c_str() ) == 0;
+    }
+  if( !ok )
+    fl_unlink( tmp.c_str() );
+}
+
+static unsigned int thumb_hash( const FluSimpleString &path, int w, int h )
+{
+  return hash_string( path.c_str(), 2166136261u ^ ( w * 31 + h ) );
+}
+
+// the memory cache is only changed with the lock held. find() and insert() run
+// on the worker, but thumbnails are only deleted by trim(), on the main thread,
+// since they may have been drawn
+Flu_Thumbnail_Loader::Thumb* Flu_Thumbnail_Loader :: find( const FluSimpleString &path, int w, int h,
+							  unsigned long size, time_t mtime )
+{
+  for( Thumb *t = hash[thumb_hash( path, w, h ) % HASH_SIZE]; t; t = t->chain )
+    if( t->tw == w && t->th == h && t->fsize == size && t->mtime == mtime && t->path == path )
+      return t;
+  return NULL;
+}
+
+void Flu_Thumbnail_Loader :: insert( Thumb *t )
+{
+  Thumb **bucket = &hash[thumb_hash( t->path, t->tw, t->th ) % HASH_SIZE];
+  t->chain = *bucket;
+  *bucket = t;
+  t->prev = NULL;
+  t->next = recent;
+  if( recent )
+    recent->prev = t;
+  recent = t;
+  if( !oldest )
+    oldest = t;
+  bytes += (unsigned long)t->w() * t->h() * t->d();
+}
+
+void Flu_Thumbnail_Loader :: remove( Thumb *t )
+{
+  Thumb **p = &hash[thumb_hash( t->path, t->tw, t->th ) % HASH_SIZE];
+  while( *p != t )
+    p = &(*p)->chain;
+  *p = t->chain;
+  if( t->prev )
+    t->prev->next = t->next;
+  else
+    recent = t->next;
+  if( t->next )
+    t->next->prev = t->prev;
+  else
+    oldest = t->prev;
+  bytes -= (unsigned long)t->w() * t->h() * t->d();
+}
+
+void Flu_Thumbnail_Loader :: touch( Thumb *t )
+{
+  if( t == recent )
+    return;
+  t->prev->next = t->next;
+  if( t->next )
+    t->next->prev = t->prev;
+  else
+    oldest = t->prev;
+  t->prev = NULL;
+  t->next = recent;
+  recent->prev = t;
+  recent = t;
+}
+
+void Flu_Thumbnail_Loader :: trim()
+{
+  // thumbnails still in use stay, however far over the limit that is
+  Thumb *dead = NULL;
+  sys->lock();
+  for( Thumb *t = oldest, *prev; t && bytes > maxBytes; t = prev )
+    {
+      prev = t->prev;
+      if( t->refs > 0 )
+	continue;
+      remove( t );
+      t->chain = dead;
+      dead = t;
+    }
+  sys->unlock();
+  while( dead )
+    {
+      Thumb *t = dead;
+      dead = t->chain;
+      delete t;
+    }
+}
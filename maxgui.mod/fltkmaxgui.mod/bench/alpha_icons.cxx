@@ -0,0 +1,116 @@
+//
+// "$Id$"
+//
+// Alpha image drawing benchmark for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+// Draws N 32x32 icons with an alpha channel per frame in a double
+// buffered window and prints the time per frame, including the server's
+// work.  Build the library with HAVE_XRENDER on and off in config.h to
+// compare the XRender pictures with alpha_blend().  Needs a display:
+//
+//   c++ -O2 -I.. alpha_icons.cxx ../lib/libfltk.a -lXft -lfontconfig -lXrender -lXext -lX11 -lpthread -ldl -o alpha_icons
+//   ./alpha_icons [frames]
+
+#include <FL/Fl.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Image.H>
+#include <FL/fl_draw.H>
+#include <FL/x.H>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <sys/time.h>
+
+#define ICON 32
+
+static Fl_RGB_Image *alpha_icon;
+static int icons;	// number of icons drawn per frame
+
+class Icon_Window : public Fl_Double_Window {
+public:
+  Icon_Window(int W, int H) : Fl_Double_Window(W, H, "alpha_icons") {}
+  void draw() {
+    fl_color(FL_GRAY);
+    fl_rectf(0, 0, w(), h());
+    int cols = (w() - ICON) / 7;
+    for (int i = 0; i < icons; i++)
+      alpha_icon->draw((i % cols) * 7, (i / cols % ((h() - ICON) / 5)) * 5);
+  }
+};
+
+// a soft edged disc, so most pixels are partly transparent
+static Fl_RGB_Image *make_icon() {
+  uchar *p = new uchar[ICON*ICON*4];
+  for (int y = 0; y < ICON; y++)
+    for (int x = 0; x < ICON; x++) {
+      uchar *q = p + (y*ICON + x)*4;
+      double d = hypot(x - ICON/2 + .5, y - ICON/2 + .5) / (ICON/2);
+      q[0] = uchar(255*x/ICON);
+      q[1] = uchar(255*y/ICON);
+      q[2] = 160;
+      q[3] = d >= 1 ? 0 : uchar(255*(1 - d*d));
+    }
+  Fl_RGB_Image *img = new Fl_RGB_Image(p, ICON, ICON, 4);
+  img->alloc_array = 1;
+  return img;
+}
+
+static double now() {
+  timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec + t.tv_usec / 1e6;
+}
+
+int main(int argc, char **argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 200;
+  static const int sizes[] = {1, 10, 100, 500, 1000};
+
+  fl_open_display();
+  alpha_icon = make_icon();
+  Icon_Window win(640, 480);
+  win.show();
+  while (!win.shown() || !fl_xid(&win)) Fl::wait();
+  Fl::wait(0.5);	// let the window manager map it
+
+  printf("%8s %12s\n", "N", "ms/frame");
+  for (unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+    icons = sizes[s];
+    win.redraw(); Fl::flush(); XSync(fl_display, False);	// warm up the caches
+    double t0 = now();
+    for (int i = 0; i < frames; i++) {
+      win.redraw();
+      Fl::flush();
+      XSync(fl_display, False);
+    }
+    double t = now() - t0;
+    printf("%8d %12.3f\n", icons, t * 1e3 / frames);
+  }
+  delete alpha_icon;
+  return 0;
+}
+
+//
+// End of "$Id$".
+//
@@ -0,0 +1,119 @@
+//
+// "$Id$"
+//
+// Fl::add_fd() wakeup benchmark for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+// Measures how long Fl::wait() takes to wake up and call the callback
+// of one busy pipe while N idle pipes are registered with Fl::add_fd().
+// Build the library with USE_EPOLL on and off in config.h to compare
+// epoll with poll() or select().  X11 only, no display is needed:
+//
+//   c++ -O2 -I.. fd_wakeup.cxx ../lib/libfltk.a -lXft -lfontconfig -lXrender -lXext -lX11 -lpthread -ldl -o fd_wakeup
+//   ./fd_wakeup [wakeups]
+
+#include <config.h>
+#include <FL/Fl.H>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+static int calls;
+
+static void read_cb(int fd, void*) {
+  char c;
+  if (read(fd, &c, 1) == 1) calls++;
+}
+
+static double now() {
+  timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec + t.tv_usec / 1e6;
+}
+
+int main(int argc, char **argv) {
+  int wakeups = argc > 1 ? atoi(argv[1]) : 20000;
+  static const int sizes[] = {1, 10, 100, 500, 2000, 8000};
+
+  // every pipe takes two descriptors
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+
+#if USE_EPOLL
+  printf("backend: epoll\n");
+#elif USE_POLL
+  printf("backend: poll\n");
+#else
+  printf("backend: select\n");
+#endif
+  printf("%8s %12s\n", "N", "us/wakeup");
+
+  for (unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+    int n = sizes[s];
+    int (*p)[2] = new int[n][2];
+    int opened = 0;
+    for (; opened < n; opened++) {
+      if (pipe(p[opened]) < 0) break;
+#if !USE_EPOLL && !USE_POLL
+      if (p[opened][0] >= FD_SETSIZE) {
+        close(p[opened][0]); close(p[opened][1]);
+        break;
+      }
+#endif
+      Fl::add_fd(p[opened][0], read_cb);
+    }
+    if (opened == n) {
+      // the busy pipe is the last one, so a scan has to look at them all
+      int busy = p[n-1][1];
+      calls = 0;
+      double t0 = now();
+      for (int i = 0; i < wakeups; i++) {
+        if (write(busy, "x", 1) != 1) break;
+        Fl::wait(1.0);
+      }
+      double t = now() - t0;
+      if (calls != wakeups) fprintf(stderr, "only %d of %d callbacks\n", calls, wakeups);
+      printf("%8d %12.2f\n", n, t * 1e6 / wakeups);
+    } else {
+      printf("%8d %12s\n", n, "-");
+    }
+    for (int i = 0; i < opened; i++) {
+      Fl::remove_fd(p[i][0]);
+      close(p[i][0]);
+      close(p[i][1]);
+    }
+    delete[] p;
+    if (opened < n) break;
+  }
+  return 0;
+}
+
+//
+// End of "$Id$".
+//
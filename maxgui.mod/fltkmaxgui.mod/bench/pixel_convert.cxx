@@ -0,0 +1,179 @@
+//
+// "$Id$"
+//
+// Pixel converter benchmark for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+
+// Times the vector loops of fl_simd.H that fl_draw_image() and
+// alpha_blend() use against the plain loops they replace, on whole
+// frames, and checks that both give the same pixels.  Needs no display
+// or library:
+//
+//   c++ -O2 -I.. -I../src pixel_convert.cxx -o pixel_convert
+//   ./pixel_convert [frames]
+
+#include <config.h>
+#include "fl_simd.H"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+typedef unsigned char uchar;
+
+#if FL_SIMD
+
+// The plain loops, as in fl_draw_image.cxx and Fl_Image.cxx:
+
+static void xrgb_plain(const uchar *from, uchar *to, int w, int delta) {
+  unsigned *t = (unsigned*)to;
+  for (; w--; from += delta) *t++ = (from[0]<<16)+(from[1]<<8)+(from[2]);
+}
+
+static void xrrr_plain(const uchar *from, uchar *to, int w, int delta) {
+  unsigned *t = (unsigned*)to;
+  for (; w--; from += delta) *t++ = *from * 0x10101U;
+}
+
+static void blend_plain(const uchar *src, uchar *dst, int w, int delta) {
+  for (; w > 0; w--, src += delta, dst += 3) {
+    uchar a = src[delta-1], ia = 255 - a;
+    for (int j = 0; j < 3; j++) {
+      uchar c = delta == 4 ? src[j] : src[0];
+      dst[j] = (c * a + dst[j] * ia) >> 8;
+    }
+  }
+}
+
+// The vector versions, finishing each row with the plain loop:
+
+static void xrgb_simd(const uchar *from, uchar *to, int w, int delta) {
+  static const signed char pattern[4] = {2, 1, 0, -1};
+  int n = fl_simd_shuffle32(from, to, w, delta, pattern);
+  xrgb_plain(from + n*delta, to + 4*n, w - n, delta);
+}
+
+static void xrrr_simd(const uchar *from, uchar *to, int w, int delta) {
+  static const signed char pattern[4] = {0, 0, 0, -1};
+  int n = fl_simd_shuffle32(from, to, w, delta, pattern);
+  xrrr_plain(from + n*delta, to + 4*n, w - n, delta);
+}
+
+static void blend_simd(const uchar *src, uchar *dst, int w, int delta) {
+  int n = fl_simd_blend(src, dst, w, delta);
+  blend_plain(src + n*delta, dst + 3*n, w - n, delta);
+}
+
+typedef void (*Loop)(const uchar *, uchar *, int, int);
+
+static double now() {
+  timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec + t.tv_usec / 1e6;
+}
+
+// Runs loop over every row of a W x H frame, frames times, and returns
+// the milliseconds per frame.  dst is refilled from orig before every
+// frame so that blending always starts from the same pixels.
+static double run(Loop loop, const uchar *src, int delta, uchar *dst, int dd,
+                  const uchar *orig, int W, int H, int frames) {
+  double t = 0;
+  for (int f = 0; f < frames; f++) {
+    if (orig) memcpy(dst, orig, (size_t)W*H*dd);
+    double t0 = now();
+    for (int y = 0; y < H; y++)
+      loop(src + (size_t)y*W*delta, dst + (size_t)y*W*dd, W, delta);
+    t += now() - t0;
+  }
+  return t * 1e3 / frames;
+}
+
+struct Test {
+  const char *name;
+  Loop plain, simd;
+  int delta;	// source bytes per pixel
+  int dd;	// destination bytes per pixel
+  int blend;	// destination is read as well as written
+};
+
+int main(int argc, char **argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 50;
+  static const int sizes[][2] = {{640, 480}, {1920, 1080}, {3840, 2160}};
+  static const Test tests[] = {
+    {"xrgb from RGB", xrgb_plain, xrgb_simd, 3, 4, 0},
+    {"xrgb from RGBA", xrgb_plain, xrgb_simd, 4, 4, 0},
+    {"xrrr from gray", xrrr_plain, xrrr_simd, 1, 4, 0},
+    {"blend RGBA", blend_plain, blend_simd, 4, 3, 1},
+    {"blend gray+alpha", blend_plain, blend_simd, 2, 3, 1},
+  };
+
+  if (!fl_simd_available()) {
+    printf("this processor lacks the vector instructions fl_simd.H uses\n");
+    return 1;
+  }
+
+  printf("%-18s %11s %10s %10s %8s\n", "loop", "frame", "plain ms", "vector ms", "speedup");
+  for (unsigned s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+    int W = sizes[s][0], H = sizes[s][1];
+    size_t n = (size_t)W*H;
+    uchar *src = new uchar[n*4];
+    uchar *orig = new uchar[n*4];
+    uchar *a = new uchar[n*4];
+    uchar *b = new uchar[n*4];
+    srand(1);
+    for (size_t i = 0; i < n*4; i++) {
+      src[i] = (uchar)rand();
+      orig[i] = (uchar)rand();
+    }
+    for (unsigned k = 0; k < sizeof(tests)/sizeof(tests[0]); k++) {
+      const Test &t = tests[k];
+      const uchar *o = t.blend ? orig : 0;
+      double tp = run(t.plain, src, t.delta, a, t.dd, o, W, H, frames);
+      double tv = run(t.simd, src, t.delta, b, t.dd, o, W, H, frames);
+      char frame[32];
+      sprintf(frame, "%dx%d", W, H);
+      printf("%-18s %11s %10.3f %10.3f %7.1fx%s\n", t.name, frame, tp, tv, tp / tv,
+             memcmp(a, b, n*t.dd) ? "  MISMATCH" : "");
+    }
+    delete[] src;
+    delete[] orig;
+    delete[] a;
+    delete[] b;
+  }
+  return 0;
+}
+
+#else
+
+int main() {
+  printf("fl_simd.H has no vector loops for this processor\n");
+  return 1;
+}
+
+#endif // FL_SIMD
+
+//
+// End of "$Id$".
+//
@@ -104,6 +104,33 @@
 	#define USE_XFT 1
 	//#undef USE_XFT
 	
+	/*
+	 * HAVE_XRENDER
+	 *
+	 * Do we have the X Render extension?  Xft needs it, so it is always
+	 * there when USE_XFT is; it is used to composite images with alpha.
+	 */
+	
+	#define HAVE_XRENDER 1
+	
+	/*
+	 * HAVE_XSHM
+	 *
+	 * Do we have the MIT shared memory extension?  It is only used when
+	 * the server reports it at run time.
+	 */
+	
+	#define HAVE_XSHM 1
+	
+	/*
+	 * USE_EPOLL
+	 *
+	 * Wait for the X connection and the Fl::add_fd() descriptors with
+	 * epoll() instead of select() or poll(), which scan all of them.
+	 */
+	
+	#define USE_EPOLL 1
+	
 	/*
 	 * HAVE_XDBE:
 	 *
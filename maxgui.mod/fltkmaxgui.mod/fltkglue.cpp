@@ -13,6 +13,7 @@
 #include <FL/Fl_Tooltip.H>
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Tiled_Image.H>
+#include <FL/Fl_Atlas_Image.H>
 #include <FL/Fl_Menu_Item.H>
 #include <FL/Fl_Menu_Bar.H>
 #include <FL/Fl_Menu_Window.H>
@@ -23,6 +24,7 @@
 #include <FLU/Flu_Simple_Group.h>
 #include <FL/Fl_Hold_Browser.H>
 #include <FL/Fl_Multi_Browser.H>
+#include <FL/Fl_Virtual_Browser.H>
 #include <FL/Fl_Choice.H>
 #include <FL/Fl_Tabs.H>
 #include <FL/Fl_Pack.H>
@@ -58,7 +60,8 @@ enum fltypes
 	FLRETURNBUTTON,FLPANEL,FLGROUPPANEL,FLINPUT,FLPASSWORD,
 	FLTABS,FLGROUP,FLPACK,FLBROWSER,FLMULTIBROWSER,FLCHOICE,
 	FLTEXTEDITOR,FLTEXTDISPLAY,FLHELPVIEW,FLBOX,FLTOOLBAR,FLPROGBAR,FLSLIDER,FLSCROLLBAR,
-	FLSPINNER,FLCANVAS,FLINPUTCHOICE,FLUTREEBROWSER,FLREPEATBUTTON
+	FLSPINNER,FLCANVAS,FLINPUTCHOICE,FLUTREEBROWSER,FLREPEATBUTTON,FLVIRTUALBROWSER,
+	FLVIRTUALMULTIBROWSER
 };
 
 class Fl_AWindow;
@@ -105,6 +108,7 @@ const char *flFontName(Fl_Font i);
 int flFontSizes(int font,int *& size);
 const char *flFriendlyFontName(Fl_Font i);
 int flFriendlyFontAttributes(Fl_Font i);
+void flWidthCacheStats(int *hits,int *misses);
 
 int flChooseColor(const char *title, uchar &r, uchar &g, uchar &b) {return fl_color_chooser(title,r,g,b);}
 
@@ -117,6 +121,7 @@ char *flRequestFile(const char * message,const char *pattern,const char *path,in
 char *flRequestDir(const char* message,const char *path,int relative);
 
 void flAddTimeout(double t,void(*callback)(void*),void *user);
+void flSetTimeoutSlack(double slack);
 
 // widgets
 
@@ -217,6 +222,17 @@ void flSetBrowserTextColor(Fl_Hold_Browser *browse,int r,int g,int b);
 void flSetBrowserTextFont(Fl_Hold_Browser *browse,Fl_Font s);
 void flSetBrowserTextSize(Fl_Hold_Browser *browse,Fl_Fontsize s);
 int flBrowserCount(Fl_Hold_Browser *browse);
+void flSortBrowser(Fl_Browser *browse,int flags,int column,int *order);
+void flSortBrowserBy(Fl_Browser *browse,int flags,int *order,int (*compare)(void *a,void *b));
+
+void flSetVirtualBrowser(Fl_Virtual_Browser *browse,Fl_Virtual_Browser_Provider *provider,void *user);
+void flSetVirtualBrowserRows(Fl_Virtual_Browser *browse,int count);
+void flSetVirtualBrowserRow(Fl_Virtual_Browser *browse,const char *text,Fl_Image *icon);
+void flVirtualBrowserChanged(Fl_Virtual_Browser *browse,int line);
+void flSelectVirtualBrowser(Fl_Virtual_Browser *browse,int line,int select);
+int flVirtualBrowserSelected(Fl_Virtual_Browser *browse,int line);
+int flVirtualBrowserValue(Fl_Virtual_Browser *browse);
+int flVirtualBrowserSelection(Fl_Virtual_Browser *browse,int *lines,int max);
 
 void flCharPosXY(Fl_Text_Display *textdisplay, int charpos, int *x, int *y);
 int flLinePos(Fl_Text_Display *textdisplay,int line);
@@ -224,6 +240,10 @@ int flLineStart(Fl_Text_Display *textdisplay,int pos);
 int flLineCount(Fl_Text_Display *textdisplay,int pos);
 int flTextLength(Fl_Text_Display *textdisplay);
 void flSetWrapMode(Fl_Text_Display *textdisplay, int mode, int col);
+void flSetTextStorage(Fl_Text_Display *textdisplay, int engine);
+void flAddTextBatched(Fl_Text_Display *textdisplay,char *text);
+void flFlushText(Fl_Text_Display *textdisplay);
+void flSetTextRing(Fl_Text_Display *textdisplay, int maxbytes, int maxlines);
 
 void flAddText(Fl_Text_Display *textdisplay,char *text);
 void flReplaceText(Fl_Text_Display *textdisplay,int start,int count,char *text);
@@ -249,6 +269,8 @@ void flAddTextStyle(Fl_Text_Display *textdisplay,char *text);
 void flReplaceTextStyle(Fl_Text_Display *textdisplay,int start,int count,char *text);
 void flInsertTextStyle(Fl_Text_Display *textdisplay,int start,char *text);
 void flDeleteTextStyle(Fl_Text_Display *textdisplay,int start,int count);
+void flSetTextStyleRange(Fl_Text_Display *textdisplay,int start,int count,int style);
+void flInsertTextStyleRun(Fl_Text_Display *textdisplay,int start,int count,int style);
 void* flFreeTextDisplay(Fl_Text_Display *textdisplay);
 
 void flCutText(Fl_Text_Editor *editor);
@@ -268,7 +290,10 @@ void flSetStyleView(Fl_Help_View *view, int flag);
 void flSetProgress(Fl_Progress*,float val);
 
 Fl_RGB_Image *flImage(const unsigned char *pix,int w,int h,int d,int ld);
-void flSetImage( Fl_Widget *widget, Fl_RGB_Image *image );
+Fl_Image_Atlas *flImageAtlas(const unsigned char *pix,int w,int h,int d,int ld);
+Fl_RGB_Image *flAtlasImage(Fl_Image_Atlas *atlas,int x,int y,int w,int h);
+void flFreeImageAtlas(Fl_Image_Atlas *atlas);
+void flSetImage( Fl_Widget *widget, Fl_Image *image );
 void flFreeImage( Fl_Image *image );
 void flSetPanelColor(Fl_Panel *panel,int r,int g,int b);
 void flSetPanelImage(Fl_Panel *panel,Fl_RGB_Image *image,int flags);
@@ -299,6 +324,18 @@ int flEventKeys(int key) {return Fl::event_key(key);}
 int flEventButtons() {return Fl::event_buttons()>>24;}
 int flEventButton() {return Fl::event_button();}
 int flEventClicks() {return Fl::event_clicks();}
+void flMotionHistory(int n) {Fl::motion_history(n);}
+int flEventMotionPoints() {return Fl::event_motion_points();}
+int flEventMotionX(int i) {
+	if (i<0 || i>=Fl::event_motion_points()) return 0;
+	return Fl::event_motion_x(i);
+}
+int flEventMotionY(int i) {
+	if (i<0 || i>=Fl::event_motion_points()) return 0;
+	return Fl::event_motion_y(i);
+}
+int flWidgetsDrawn() {return Fl::widgets_drawn();}
+int flPixelsCopied() {return Fl::pixels_copied();}
 const char *flEventText() {return Fl::event_text();}
 int flCompose(int &del){return Fl::compose(del);}
 const char *flEventURL() {return event_url;}
@@ -314,7 +351,7 @@ void* fluSelectedNode( Flu_Tree_Browser* tree, int index );
 void* fluInsertNode( Flu_Tree_Browser::Node* parent, int pos, const char* text );
 void* fluAddNode( Flu_Tree_Browser::Node* parent, const char* text );
 void fluRemoveNode( Flu_Tree_Browser* tree, Flu_Tree_Browser::Node* node );
-void fluSetNode( Flu_Tree_Browser::Node* node, const char* text, Fl_RGB_Image* iconimage );
+void fluSetNode( Flu_Tree_Browser::Node* node, const char* text, Fl_Image* iconimage );
 void fluSetNodeUserData( Flu_Tree_Browser::Node* node, void* user_data );
 void* fluNodeUserData( Flu_Tree_Browser::Node* node );
 void fluExpandNode( Flu_Tree_Browser::Node* node, int collapse );
@@ -378,6 +415,10 @@ void flReset(void *display,int(*handler)(int),int(*filter)(void*),int(*msehandle
 	fl_message_font( FL_HELVETICA, FL_NORMAL_SIZE );
 	Fl_Tooltip::size( FL_NORMAL_SIZE );
 	
+	// lets worker threads, like the file chooser's thumbnail loader,
+	// hand their results to the main thread with Fl::awake()
+	Fl::lock();
+
 	fl_register_images();
 	Fl::scheme("gtk+");
 	if (handler)
@@ -422,6 +463,14 @@ int flFontSizes(Fl_Font font,int *& sizes)
 	return Fl::get_font_sizes(font,*&sizes);
 }
 
+void flWidthCacheStats(int *hits,int *misses)
+{
+	unsigned long h, m;
+	fl_width_cache_stats(h,m);
+	*hits=(int)h;
+	*misses=(int)m;
+}
+
 void flSetBelowMouse(Fl_Widget* widget){Fl::belowmouse(widget);};
 
 void flDisplayRect(int*x,int*y,int*w,int*h)
@@ -437,6 +486,11 @@ void flAddTimeout(double t,void(*callback)(void*),void *user)
 	Fl::add_timeout(t,callback,user);
 }
 
+void flSetTimeoutSlack(double slack)
+{
+	Fl::timeout_slack(slack);
+}
+
 int flRequest(const char *text,int flags)
 {
 	switch (flags)
@@ -485,24 +539,94 @@ int isboxaframe( int box ){
 	return 0;
 }
 
+// box types that paint every pixel of their area, so what is behind
+// them never shows through
+int isboxopaque( int box ){
+	switch(box){
+		case FL_FLAT_BOX:
+		case FL_UP_BOX:
+		case FL_DOWN_BOX:
+		case FL_THIN_UP_BOX:
+		case FL_THIN_DOWN_BOX:
+		case FL_ENGRAVED_BOX:
+		case FL_EMBOSSED_BOX:
+		case FL_BORDER_BOX:
+		return 1;
+	}
+	return 0;
+}
+
+// seconds a resized panel waits for the next resize before it
+// replaces its quick preview of the image with a smooth one
+#define PANEL_RESCALE_DELAY 0.25
+
+// Panels with an opaque box keep their box and image composited in an
+// offscreen, which is rebuilt only when its size, box, colour or image
+// change; transparent ones draw them directly.  The pixels behind the
+// label are read from the screen again whenever the label moves or the
+// parent has drawn what is behind it.
 class Fl_Panel:public Fl_Group
 {
-	Fl_Image	*origimage;
+	Fl_RGB_Image	*origimage;
 	Fl_Image	*img;
+	Fl_Tiled_Image	*tile;		// tiles img for PANELPIXMAP_TILE
 	int			pixmapflags;
 	int			hascolor;
 	int			active;
 	int			enabled;
+	int			preview;	// img is a nearest-neighbour preview
+	Fl_Offscreen	bg;			// box and image, 0 if not built
+	int			bgw, bgh, bgbox, bgactive;
+	Fl_Color	bgcolor;
+	uchar		*labelpix;	// what was behind the label
+	int			labelx, labely, labelw, labelh;
 public:
 	Fl_Panel(int x,int y,int w,int h,const char *title):Fl_Group(x,y,w,h,title)
 	{
 		box(FL_ENGRAVED_FRAME);align(FL_ALIGN_LEFT|FL_ALIGN_INSIDE);
 		clip_children(true);resizable(NULL);
-		img=NULL;origimage=NULL;pixmapflags=0;
-		hascolor=0;active=0;enabled=1;
+		img=NULL;origimage=NULL;tile=NULL;pixmapflags=0;
+		hascolor=0;active=0;enabled=1;preview=0;
+		bg=0;labelpix=NULL;
+	}
+	~Fl_Panel()
+	{
+		Fl::remove_timeout(rescale_cb,this);
+		freeimage();
+		invalidate();
+	}
+	static void rescale_cb(void *p)
+	{
+		Fl_Panel *panel = (Fl_Panel*)p;
+		if (!panel->preview || !panel->img || !panel->origimage) return;
+		int neww = panel->img->w(), newh = panel->img->h();
+		panel->freeimage();
+		panel->img = panel->origimage->copy(neww,newh,FL_RGB_SCALING_BICUBIC);
+		if (!panel->enabled) panel->img->inactive();
+		panel->preview = 0;
+		panel->redraw();
+	}
+	void freeimage()
+	{
+		if (tile) delete tile;
+		if (img) delete img;
+		tile = NULL;img = NULL;
+		if (bg) {fl_delete_offscreen(bg);bg = 0;}
+	}
+	// forgets the cached background and label backing
+	void invalidate()
+	{
+		if (bg) {fl_delete_offscreen(bg);bg = 0;}
+		if (labelpix) {delete[] labelpix;labelpix = NULL;}
+	}
+	void resize(int x,int y,int w,int h)
+	{
+		if (x!=this->x() || y!=this->y() || w!=this->w() || h!=this->h()) invalidate();
+		Fl_Group::resize(x,y,w,h);
 	}
 	void setimage(Fl_RGB_Image *i,int flags)
 	{
+		if (i!=origimage || flags!=pixmapflags) invalidate();
 		pixmapflags = flags;
 		if(origimage!=i){
 			if(origimage) origimage = NULL;
@@ -514,6 +638,7 @@ public:
 	}
 	void setcolor(Fl_Color c)
 	{
+		invalidate();
 		if(!hascolor){
 			hascolor=1;
 			switch(box()){
@@ -537,10 +662,7 @@ public:
 		
 		if(enabled!=yesno){
 			enabled=(yesno ? 1 : 0);
-			if(img){
-				delete img;
-				img = NULL;
-			}
+			freeimage();
 			updateImage();
 		} else {
 			enabled=(yesno ? 1 : 0);
@@ -570,23 +692,54 @@ public:
 			int neww = scalew * origimage->w(), newh = scaleh * origimage->h();
 			
 			if (!img || (neww != img->w()) || (newh != img->h())){
-				if (img) delete img;
-				img = origimage->copy(neww,newh);
+				// while the panel is being resized only draw a cheap
+				// preview, the smooth copy is made once it settles
+				int resizing = (img != NULL) && (neww != origimage->w() || newh != origimage->h());
+				freeimage();
+				if (neww == origimage->w() && newh == origimage->h())
+					img = origimage->copy();	// icons of an atlas share it
+				else
+					img = origimage->copy(neww,newh,resizing ? FL_RGB_SCALING_NEAREST : FL_RGB_SCALING_BICUBIC);
 				if (!enabled) img->inactive();
+				preview = resizing;
+				Fl::remove_timeout(rescale_cb,this);
+				if (preview) Fl::add_timeout(PANEL_RESCALE_DELAY,rescale_cb,this);
 			}
 			
 		} else {
-			if (img) delete img;
-			img = NULL;
+			freeimage();
+			preview = 0;
+			Fl::remove_timeout(rescale_cb,this);
 		}
 		
 	}
 	
+	// draws the box and image into the area of the box, whose top left
+	// corner is drawn at ox,oy
+	void drawbackground(int ox,int oy,int dw,int dh,int lblH)
+	{
+		fl_draw_box( box(), ox, oy, dw, dh, color() );
+		if (img){
+			int dx = ox, dy = oy;
+			if ((box()!=FL_NO_BOX) && (box()!=FL_FLAT_BOX)) {dx+=3;dy+=3;dw-=6;dh-=6;}
+			fl_push_clip(dx,dy,dw,dh);
+			switch(pixmapflags){
+				case PANELPIXMAP_TILE:
+					if (!tile) tile = new Fl_Tiled_Image(img);
+					tile->draw(dx,dy,dw,dh,0,0);
+					break;
+				default:
+					img->draw(ox+w()/2-img->w()/2,oy-lblH/2+h()/2-img->h()/2);
+					break;
+			}
+			fl_pop_clip();
+		}
+	}
+	
 	void draw()
 	{
 		
 		int lblW = 0, lblH, X, dx, dy, dw, dh;
-		uchar* pix;
 		
 		if( (label() == 0) )
 		  lblW = lblH = 0;
@@ -607,26 +760,38 @@ public:
 		else
 		  X = w()/2 - lblW/2 - 2;
 		
-		// save label background to an image in memory
-		if(lblW && lblH) pix = fl_read_image(NULL,x()+X,y(),lblW+4,lblH,0); else pix = NULL;
+		// save label background to an image in memory, once for each place
+		// and each time the parent redraws it (a new colour or image, or
+		// its smooth rescale); when only the panel redraws the copy is still good
+		if(lblW && lblH) {
+			if (!labelpix || labelx!=x()+X || labely!=y() || labelw!=lblW+4 || labelh!=lblH ||
+				(parent() && (parent()->damage() & ~FL_DAMAGE_CHILD))) {
+				if (labelpix) delete[] labelpix;
+				labelx = x()+X;labely = y();labelw = lblW+4;labelh = lblH;
+				labelpix = fl_read_image(NULL,labelx,labely,labelw,labelh,0);
+			}
+		}
 		
 		// draw the main group box
 		if( damage() & ~FL_DAMAGE_CHILD ){
 			dx=x();dy=y()+lblH/2;dw=w();dh=h()-lblH/2;
-			fl_draw_box( box(), dx, dy, dw, dh, color() );
-			if (img){
-				if ((box()!=FL_NO_BOX) && (box()!=FL_FLAT_BOX)) {dx+=3;dy+=3;dw-=6;dh-=6;}
-				fl_clip(dx,dy,dw,dh);
-				switch(pixmapflags){
-					case PANELPIXMAP_TILE:
-						img = new Fl_Tiled_Image(img,dw,dh);
-						break;
-					default:
-						dx = x()+w()/2-img->w()/2;dy = y()+h()/2-img->h()/2;
-						break;
+			if (isboxopaque(box()) && dw>0 && dh>0) {
+				if (bg && (bgw!=dw || bgh!=dh || bgbox!=box() || bgcolor!=color() || bgactive!=active_r())) {
+					fl_delete_offscreen(bg);bg = 0;
+				}
+				if (!bg) {
+					bg = fl_create_offscreen(dw,dh);
+					fl_begin_offscreen(bg);
+					drawbackground(0,0,dw,dh,lblH);
+					fl_end_offscreen();
+					bgw = dw;bgh = dh;bgbox = box();bgcolor = color();bgactive = active_r();
 				}
-				img->draw(dx,dy);
-				fl_pop_clip();
+				// only copy the part that is being redrawn
+				int cx, cy, cw, ch;
+				fl_clip_box(dx,dy,dw,dh,cx,cy,cw,ch);
+				if (cw>0 && ch>0) fl_copy_offscreen(cx,cy,cw,ch,bg,cx-dx,cy-dy);
+			} else {
+				drawbackground(dx,dy,dw,dh,lblH);
 			}
 		}
 		
@@ -636,12 +801,13 @@ public:
 		draw_children();
 		fl_pop_clip();
 		
-		if(lblW && lblH) {
+		// the children are clipped below the label, so it only needs
+		// drawing when the panel itself is damaged
+		if(lblW && lblH && (damage() & ~FL_DAMAGE_CHILD)) {
 			
 			// clear behind the label and draw it
-			if(pix) {
-				fl_draw_image( pix,x()+X,y(),lblW+4,lblH,3,0);
-				delete[] pix;
+			if(labelpix) {
+				fl_draw_image( labelpix,labelx,labely,labelw,labelh,3,0);
 			} else {
 				fl_color( color() );
 				fl_rectf( x()+X,y(),lblW+4,lblH );
@@ -928,6 +1094,7 @@ Fl_Widget *flWidget(int x,int y,int w,int h,char *label,int fltype)
 	Fl_Group	*group;
 	Fl_Menu_Bar	*menu;
 	Fl_Browser	*browser;
+	Fl_Virtual_Browser	*vbrowser;
 	Fl_Text_Buffer	*text;
 	Fl_Help_View	*help;
 	Fl_Choice	*choice;
@@ -995,6 +1162,12 @@ Fl_Widget *flWidget(int x,int y,int w,int h,char *label,int fltype)
 		else browser=new MaxGUIEventListener<Fl_Multi_Browser>(x,y,w,h,label);
 		browser->column_widths(colwidths);
 		return browser;
+	case FLVIRTUALMULTIBROWSER:
+	case FLVIRTUALBROWSER:
+		vbrowser=new MaxGUIEventListener<Fl_Virtual_Browser>(x,y,w,h,label);
+		vbrowser->type(fltype==FLVIRTUALBROWSER?FL_HOLD_BROWSER:FL_MULTI_BROWSER);
+		vbrowser->column_widths(colwidths);
+		return vbrowser;
 	case FLINPUTCHOICE:
 		group= new MaxGUIEventListener<Fl_Input_Choice>(x,y,w,h,label);
 		group->end();
@@ -1393,7 +1566,24 @@ Fl_RGB_Image *flImage(const unsigned char *pix,int w,int h,int d,int span)
 	return new Fl_RGB_Image(pix,w,h,d,span);
 }
 
-void flSetImage(Fl_Widget *widget,Fl_RGB_Image *image)
+Fl_Image_Atlas *flImageAtlas(const unsigned char *pix,int w,int h,int d,int span)
+{
+	return new Fl_Image_Atlas(pix,w,h,d,span);
+}
+
+Fl_RGB_Image *flAtlasImage(Fl_Image_Atlas *atlas,int x,int y,int w,int h)
+{
+	return new Fl_Atlas_Image(atlas,x,y,w,h);
+}
+
+void flFreeImageAtlas(Fl_Image_Atlas *atlas)
+{
+	atlas->release();
+}
+
+// copies of atlas images share the atlas, and the inactive copy uses the
+// inactive version of the whole atlas, made once
+void flSetImage(Fl_Widget *widget,Fl_Image *image)
 {
 	Fl_Image*	copy;
 	if(widget->image()) delete widget->image();
@@ -1594,6 +1784,110 @@ int flBrowserCount(Fl_Hold_Browser *browse)
 	return browse->size();
 }
 
+// while sorting, the data of every line points to one of these, so the
+// original line numbers can be read back afterwards
+
+struct BrowserSortEntry
+{
+	int		index;
+	void	*data;
+};
+
+static int BrowserSortCompare(const char *a,void *adata,const char *b,void *bdata,void *arg)
+{
+	int (*compare)(void*,void*)=(int(*)(void*,void*))arg;
+	return compare(((BrowserSortEntry*)adata)->data,((BrowserSortEntry*)bdata)->data);
+}
+
+static void SortBrowser(Fl_Browser *browse,int flags,int column,int *order,int (*compare)(void*,void*))
+{
+	int i,n=browse->size();
+	if (n==0) return;
+	BrowserSortEntry *entries=(BrowserSortEntry*)malloc(n*sizeof(BrowserSortEntry));
+	for (i=0;i<n;i++)
+	{
+		entries[i].index=i;
+		entries[i].data=browse->data(i+1);
+		browse->data(i+1,&entries[i]);
+	}
+	if (compare)
+		browse->sort(flags,-1,BrowserSortCompare,(void*)compare);
+	else
+		browse->sort(flags,column);
+	for (i=0;i<n;i++)
+	{
+		BrowserSortEntry *e=(BrowserSortEntry*)browse->data(i+1);
+		if (order) order[i]=e->index;
+		browse->data(i+1,e->data);
+	}
+	free(entries);
+	browse->redraw();
+}
+
+// order[i] receives the old index of the item now at index i
+
+void flSortBrowser(Fl_Browser *browse,int flags,int column,int *order)
+{
+	SortBrowser(browse,flags,column,order,0);
+}
+
+void flSortBrowserBy(Fl_Browser *browse,int flags,int *order,int (*compare)(void *a,void *b))
+{
+	SortBrowser(browse,flags,-1,order,compare);
+}
+
+// virtual browser, the provider is called as provider(widget,line,user)
+
+void flSetVirtualBrowser(Fl_Virtual_Browser *browse,Fl_Virtual_Browser_Provider *provider,void *user)
+{
+	browse->provider(provider,user);
+}
+
+void flSetVirtualBrowserRows(Fl_Virtual_Browser *browse,int count)
+{
+	browse->size(count);
+}
+
+void flSetVirtualBrowserRow(Fl_Virtual_Browser *browse,const char *text,Fl_Image *icon)
+{
+	browse->set_line(text,icon);
+}
+
+void flVirtualBrowserChanged(Fl_Virtual_Browser *browse,int line)
+{
+	browse->changed(line);
+}
+
+void flSelectVirtualBrowser(Fl_Virtual_Browser *browse,int line,int select)
+{
+	if (browse->type()!=FL_MULTI_BROWSER) browse->deselect();
+	if (line) browse->select(line,select);
+}
+
+int flVirtualBrowserSelected(Fl_Virtual_Browser *browse,int line)
+{
+	return browse->selected(line);
+}
+
+int flVirtualBrowserValue(Fl_Virtual_Browser *browse)
+{
+	return browse->value();
+}
+
+// fills lines with up to max selected lines and returns how many there are
+
+int flVirtualBrowserSelection(Fl_Virtual_Browser *browse,int *lines,int max)
+{
+	int i,n=0;
+	for (i=1;i<=browse->size();i++)
+	{
+		if (!browse->selected(i)) continue;
+		if (n<max) lines[n]=i;
+		n++;
+	}
+	return n;
+}
+
 void flSelectTab(Fl_Tabs *tab,Fl_Widget *widget)
 {
 	tab->value(widget);
@@ -1682,6 +1976,26 @@ void flSetWrapMode(Fl_Text_Display *textdisplay, int mode, int col)
 	textdisplay->wrap_mode(mode,col);
 }
 
+void flSetTextStorage(Fl_Text_Display *textdisplay, int engine)
+{
+	textdisplay->buffer()->storage(engine);
+}
+
+void flAddTextBatched(Fl_Text_Display *textdisplay,char *text)
+{
+	textdisplay->buffer()->batch_append(text);
+}
+
+void flFlushText(Fl_Text_Display *textdisplay)
+{
+	textdisplay->buffer()->flush_batch();
+}
+
+void flSetTextRing(Fl_Text_Display *textdisplay, int maxbytes, int maxlines)
+{
+	textdisplay->buffer()->ring_limit(maxbytes,maxlines);
+}
+
 void flReplaceText(Fl_Text_Display *textdisplay,int start,int count,char *text)
 {
 	Fl_Text_Buffer 	*buff;
@@ -1763,20 +2077,52 @@ void flPasteText(Fl_Text_Editor *editor)
 
 typedef Fl_Text_Display::Style_Table_Entry style;
 
-#define FLSTYLE_TABLELENGTH 128
-
 struct flStyle
 {
-	flStyle			*next;
-	Fl_Text_Display	*owner;
-	Fl_Text_Buffer	*buffer;
-	int				count;
-	style			table[128];
-	flStyle			*prev;
+	flStyle				*next;
+	Fl_Text_Display		*owner;
+	Fl_Text_Style_Runs	*runs;
+	int					count;
+	int					alloc;
+	style				*table;
+	int					*hash;		// indices into table, -1 for empty slots
+	int					hashsize;	// power of 2, at least twice count
+	flStyle				*prev;
 };
 
 static flStyle *stylelist = NULL;
 
+static unsigned StyleHash(Fl_Color rgb,Fl_Font font,Fl_Fontsize size)
+{
+	unsigned h=(unsigned)rgb*2654435761U;
+	h^=(unsigned)font*40503U+(unsigned)size*16777619U;
+	return h^(h>>15);
+}
+
+static void RehashStyles(flStyle *s)
+{
+	int		i,j;
+	style	*e,*f;
+	for (i=0;i<s->hashsize;i++) s->hash[i]=-1;
+	for (i=0;i<s->count;i++)
+	{
+		e=&s->table[i];
+		j=StyleHash(e->color,e->font,e->size)&(s->hashsize-1);
+		while (s->hash[j]!=-1)
+		{
+			f=&s->table[s->hash[j]];
+			if (f->color==e->color && f->font==e->font && f->size==e->size) break;
+			j=(j+1)&(s->hashsize-1);
+		}
+		if (s->hash[j]==-1) s->hash[j]=i;
+	}
+}
+
+static void AttachStyles(flStyle *s)
+{
+	s->owner->highlight_data(s->runs,s->table,s->count?s->count:1,'A',0,0);
+}
+
 flStyle *GetStyle(Fl_Text_Display *e)
 {
 	flStyle	*s;
@@ -1792,10 +2138,14 @@ flStyle *GetStyle(Fl_Text_Display *e)
 		stylelist=s;
 		s->prev = NULL;
 		s->owner=e;
-		s->buffer=new Fl_Text_Buffer;
-		memset(s->table,0,sizeof(s->table));
+		s->runs=new Fl_Text_Style_Runs;
 		s->count=0;
-		e->highlight_data(s->buffer,s->table,FLSTYLE_TABLELENGTH,'A',0,0);	//stylecallback,s);
+		s->alloc=16;
+		s->table=(style*)calloc(s->alloc,sizeof(style));
+		s->hashsize=32;
+		s->hash=(int*)malloc(s->hashsize*sizeof(int));
+		RehashStyles(s);
+		AttachStyles(s);
 	}
 	return s;
 }
@@ -1813,14 +2163,16 @@ void* flFreeTextDisplay(Fl_Text_Display *textdisplay)
 				if(s->next) s->next->prev = s->prev;
 			} else {
 				stylelist = s->next;
-				stylelist->prev = NULL;
+				if(stylelist) stylelist->prev = NULL;
 			}
 			break;
 		}
 	}
 	
 	if (s){
-		delete s->buffer;
+		delete s->runs;
+		free(s->table);
+		free(s->hash);
 		delete s;
 	}
 	
@@ -1833,10 +2185,11 @@ void flSetTextFont(Fl_Text_Display *textdisplay,Fl_Font s)
 	int			i;
 	textdisplay->textfont(s);
 	style=GetStyle(textdisplay);
-	for (i=0;i<FLSTYLE_TABLELENGTH;i++)
+	for (i=0;i<style->alloc;i++)
 	{
 		style->table[i].font=(Fl_Font)s;
 	}
+	RehashStyles(style);
 }
 
 void flSetTextSize(Fl_Text_Display *textdisplay,Fl_Fontsize s)
@@ -1845,83 +2198,121 @@ void flSetTextSize(Fl_Text_Display *textdisplay,Fl_Fontsize s)
 	int			i;
 	textdisplay->textsize(s);
 	style=GetStyle(textdisplay);
-	for (i=0;i<FLSTYLE_TABLELENGTH;i++)
+	for (i=0;i<style->alloc;i++)
 	{
 		style->table[i].size=s;
 	}
+	RehashStyles(style);
 }
 
 int flGetTextStyleChar(Fl_Text_Display *textdisplay,int r,int g,int b,Fl_Font font,Fl_Fontsize size)
 {
 	flStyle		*s;
 	style		*e;
-	int			i;
+	int			i,j;
 	Fl_Color	rgb;
 	
 	s=GetStyle(textdisplay);
 	rgb=fl_rgb_color(r,g,b);
-	for (i=0;i<s->count;i++)
+	j=StyleHash(rgb,font,size)&(s->hashsize-1);
+	while ((i=s->hash[j])!=-1)
 	{
 		e=&s->table[i];
 		if (e->color==rgb && e->size==size && e->font==font) return 'A'+i;
+		j=(j+1)&(s->hashsize-1);
+	}
+	if (s->count==s->alloc)
+	{
+		s->alloc*=2;
+		s->table=(style*)realloc(s->table,s->alloc*sizeof(style));
+		memset(s->table+s->count,0,(s->alloc-s->count)*sizeof(style));
 	}
-	if (s->count==FLSTYLE_TABLELENGTH) return 0;
 	e=&s->table[s->count];
 	e->color=rgb;
 	e->font=(Fl_Font)font;
 	e->size=size;
-	return 'A'+s->count++;
+	s->hash[j]=s->count++;
+	if (s->count*2>s->hashsize)
+	{
+		s->hashsize*=2;
+		s->hash=(int*)realloc(s->hash,s->hashsize*sizeof(int));
+		RehashStyles(s);
+	}
+	AttachStyles(s);
+	return 'A'+s->count-1;
+}
+
+// style strings have one style character for each byte of text
+
+static void InsertStyleText(Fl_Text_Style_Runs *runs,int pos,const char *text)
+{
+	int	n=0,style=0;
+	for (;*text;text++)
+	{
+		if (n && (unsigned char)*text!=style)
+		{
+			runs->insert(pos,n,style);
+			pos+=n;
+			n=0;
+		}
+		style=(unsigned char)*text;
+		n++;
+	}
+	runs->insert(pos,n,style);
 }
 
 void flSetTextStyle(Fl_Text_Display *textdisplay,char *text)
 {
-	Fl_Text_Buffer	*buff;
 	flStyle			*s;	
 	s=GetStyle(textdisplay);
-	buff=s->buffer;
-	buff->remove(0,buff->length());
-	buff->append(text);	
+	s->runs->clear();
+	InsertStyleText(s->runs,0,text);
 }
 
 void flAddTextStyle(Fl_Text_Display *textdisplay,char *text)
 {
-	Fl_Text_Buffer	*buff;
 	flStyle			*s;	
 	s=GetStyle(textdisplay);
-	buff=s->buffer;
-	buff->append(text);	
+	InsertStyleText(s->runs,s->runs->length(),text);
 }
 
 void flReplaceTextStyle(Fl_Text_Display *textdisplay,int start,int count,char *text)
 {
-	Fl_Text_Buffer	*buff;
 	flStyle			*s;	
 	s=GetStyle(textdisplay);
-	buff=s->buffer;
-	if (count<0) count=buff->length()-start;	
-	buff->replace(start,start+count,text);
+	if (count<0) count=s->runs->length()-start;	
+	s->runs->remove(start,start+count);
+	InsertStyleText(s->runs,start,text);
 }
 
 void flInsertTextStyle(Fl_Text_Display *textdisplay,int start,char *text)
 {
-	Fl_Text_Buffer	*buff;
 	flStyle			*s;	
 	s=GetStyle(textdisplay);
-	buff=s->buffer;
-	if (buff) buff->insert(start,text);
+	InsertStyleText(s->runs,start,text);
 }
 
 void flDeleteTextStyle(Fl_Text_Display *textdisplay,int start,int count)
 {
-	Fl_Text_Buffer	*buff;
 	flStyle			*s;	
 	s=GetStyle(textdisplay);
-	buff=s->buffer;
-	if (buff)
-	{
-		if (count<0) count=buff->length()-start;
-		buff->remove(start,count);
-	}
+	if (count<0) count=s->runs->length()-start;
+	s->runs->remove(start,start+count);
+}
+
+void flSetTextStyleRange(Fl_Text_Display *textdisplay,int start,int count,int style)
+{
+	flStyle			*s;	
+	s=GetStyle(textdisplay);
+	if (count<0) count=s->runs->length()-start;
+	s->runs->set(start,start+count,style);
+}
+
+void flInsertTextStyleRun(Fl_Text_Display *textdisplay,int start,int count,int style)
+{
+	flStyle			*s;	
+	s=GetStyle(textdisplay);
+	s->runs->insert(start,count,style);
 }
 
 void flSetView(Fl_Help_View *view, const char *html)
@@ -2032,7 +2423,7 @@ void* fluAddNode( Flu_Tree_Browser::Node* parent, const char* text ){
 void fluRemoveNode( Flu_Tree_Browser* tree, Flu_Tree_Browser::Node* node ){
 	tree->remove( node );
 }
-void fluSetNode( Flu_Tree_Browser::Node* node, const char* text, Fl_RGB_Image* iconimage ){
+void fluSetNode( Flu_Tree_Browser::Node* node, const char* text, Fl_Image* iconimage ){
 	node->label( text );node->leaf_icon( iconimage );node->branch_icon( iconimage );
 }
 void fluSetNodeUserData( Flu_Tree_Browser::Node* node, void* user_data ){
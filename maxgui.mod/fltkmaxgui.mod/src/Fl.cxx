@@ -78,12 +78,18 @@ int		Fl::damage_,
 		Fl::e_is_click,
 		Fl::e_keysym,
                 Fl::e_original_keysym,
+		Fl::e_motion_n,
+		Fl::e_motion_max,
 		Fl::scrollbar_size_ = 16;
 
+int		*Fl::e_motion_xy;
 char		*Fl::e_text = (char *)"";
 int		Fl::e_length;
 int		Fl::visible_focus_ = 1,
 		Fl::dnd_text_ops_ = 1;
+double		Fl::timeout_slack_;
+int		Fl::widgets_drawn_,
+		Fl::pixels_copied_;
 
 Fl_Window *fl_xfocus;	// which window X thinks has focus
 Fl_Window *fl_xmousewin;// which window X thinks has FL_ENTER
@@ -129,6 +135,27 @@ void Fl::scrollbar_size(int W) {
   scrollbar_size_ = W;
 }
 
+/**
+  Keeps up to \p n of the pointer positions that were merged into each
+  FL_MOVE or FL_DRAG event, for drawing programs that want to follow
+  the pointer exactly. If more positions were merged, the oldest are
+  dropped. 0, the default, turns the history off.
+  \see event_motion_points(), event_motion_x(), event_motion_y()
+*/
+void Fl::motion_history(int n) {
+  if (n < 0) n = 0;
+  if (n) {
+    int *xy = (int*)realloc(e_motion_xy, 2*n*sizeof(int));
+    if (!xy) return;
+    e_motion_xy = xy;
+  } else {
+    free(e_motion_xy);
+    e_motion_xy = 0;
+  }
+  e_motion_max = n;
+  e_motion_n = 0;
+}
+
 
 /**
     Returns whether or not the mouse event is inside the given rectangle.
@@ -176,45 +203,128 @@ int Fl::event_inside(const Fl_Widget *o) /*const*/ {
 
 
 ////////////////////////////////////////////////////////////////
-// Timeouts are stored in a sorted list, so only the first one needs
-// to be checked to see if any should be called.
+// Timeouts are kept in a binary heap on the time they are due, so only
+// the first one needs to be checked to see if any should be called, and
+// adding or removing one is O(log n).  The times are read from a clock
+// that never goes backwards, so nothing has to be updated as time
+// passes.  A hash table on the callback and its argument finds the
+// timeouts to remove without searching the heap.
   
 struct Timeout {
-  double time;
+  double time;		// when it is due, see clock_now
+  unsigned long seq;	// order of adding, so equal times run in that order
   void (*cb)(void*);
   void* arg;
-  Timeout* next;
+  int index;		// position in heap
+  Timeout* next;	// next in the same hash chain, or on the free list
 };
-static Timeout* first_timeout, *free_timeout;
-static int first_timeout_count, free_timeout_count;
+static Timeout** heap;
+static int heap_size, heap_alloc;
+static Timeout** timeout_hash;
+static int timeout_hash_size;
+static Timeout* free_timeout;
+static unsigned long timeout_seq;
 
 #include <sys/time.h>
+#include <time.h>
 
-// I avoid the overhead of getting the current time when we have no
-// timeouts by setting this flag instead of getting the time.
-// In this case calling elapse_timeouts() does nothing, but records
-// the current time, and the next call will actualy elapse time.
-static char reset_clock = 1;
+// The time in seconds, on a monotonic clock where there is one.  Timeouts
+// are compared to the time it returned last, so that all those that are
+// due when Fl::wait() looks are called even if their callbacks take a while.
+static double clock_now;
 
 static void elapse_timeouts() {
-  static struct timeval prevclock;
-  struct timeval newclock;
-  gettimeofday(&newclock, NULL);
-  double elapsed = newclock.tv_sec - prevclock.tv_sec +
-    (newclock.tv_usec - prevclock.tv_usec)/1000000.0;
-  prevclock.tv_sec = newclock.tv_sec;
-  prevclock.tv_usec = newclock.tv_usec;
-  if (reset_clock) {
-    reset_clock = 0;
-  } else if (elapsed > 0) {
-    for (Timeout* t = first_timeout; t; t = t->next) t->time -= elapsed;
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    clock_now = ts.tv_sec + ts.tv_nsec/1000000000.0;
+    return;
+  }
+#endif
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  clock_now = tv.tv_sec + tv.tv_usec/1000000.0;
+}
+
+static inline int timeout_before(const Timeout* a, const Timeout* b) {
+  return a->time < b->time || (a->time == b->time && a->seq < b->seq);
+}
+
+static void heap_set(int i, Timeout* t) {
+  heap[i] = t;
+  t->index = i;
+}
+
+// Moves the timeout at i towards the top or the bottom of the heap until
+// it is in order again.
+static void heap_fix(int i) {
+  Timeout* t = heap[i];
+  while (i > 0 && timeout_before(t, heap[(i-1)/2])) {
+    heap_set(i, heap[(i-1)/2]);
+    i = (i-1)/2;
+  }
+  for (;;) {
+    int c = 2*i+1;
+    if (c >= heap_size) break;
+    if (c+1 < heap_size && timeout_before(heap[c+1], heap[c])) c++;
+    if (!timeout_before(heap[c], t)) break;
+    heap_set(i, heap[c]);
+    i = c;
+  }
+  heap_set(i, t);
+}
+
+static unsigned timeout_hash_of(void (*cb)(void*), void* arg) {
+  unsigned long h = (unsigned long)(size_t)cb * 31 + (unsigned long)(size_t)arg;
+  h ^= h >> 16;
+  return (unsigned)(h ^ (h >> 7)) & (timeout_hash_size - 1);
+}
+
+static void timeout_hash_add(Timeout* t) {
+  if (heap_size > timeout_hash_size) {
+    // keep the chains short
+    int n = timeout_hash_size ? 2*timeout_hash_size : 64;
+    Timeout** old = timeout_hash;
+    int old_size = timeout_hash_size;
+    timeout_hash = new Timeout*[n];
+    memset(timeout_hash, 0, n*sizeof(Timeout*));
+    timeout_hash_size = n;
+    for (int i = 0; i < old_size; i++)
+      for (Timeout* u = old[i]; u;) {
+	Timeout* next = u->next;
+	unsigned h = timeout_hash_of(u->cb, u->arg);
+	u->next = timeout_hash[h];
+	timeout_hash[h] = u;
+	u = next;
+      }
+    delete[] old;
   }
+  unsigned h = timeout_hash_of(t->cb, t->arg);
+  t->next = timeout_hash[h];
+  timeout_hash[h] = t;
+}
+
+// Takes a timeout out of the heap and the hash table and frees it.
+static void unlink_timeout(Timeout* t) {
+  Timeout** p = &timeout_hash[timeout_hash_of(t->cb, t->arg)];
+  while (*p != t) p = &((*p)->next);
+  *p = t->next;
+  int i = t->index;
+  Timeout* last = heap[--heap_size];
+  if (last != t) {
+    heap_set(i, last);
+    heap_fix(i);
+  }
+  t->next = free_timeout;
+  free_timeout = t;
 }
 
 // Continuously-adjusted error value, this is a number <= 0 for how late
 // we were at calling the last timeout. This appears to make repeat_timeout
 // very accurate even when processing takes a significant portion of the
-// time interval:
+// time interval.  It is positive when the timeout was called early
+// because it was due within timeout_slack() of another one.  It only
+// applies inside a timeout callback and is 0 the rest of the time.
 static double missed_timeout_by;
 
 void Fl::add_timeout(double time, Fl_Timeout_Handler cb, void *argp) {
@@ -227,25 +337,31 @@ void Fl::repeat_timeout(double time, Fl_Timeout_Handler cb, void *argp) {
   Timeout* t = free_timeout;
   if (t) {
       free_timeout = t->next;
-      --free_timeout_count;
   } else {
       t = new Timeout;
   }
-  t->time = time;
+  t->time = clock_now + time;
+  t->seq = timeout_seq++;
   t->cb = cb;
   t->arg = argp;
-  // insert-sort the new timeout:
-  Timeout** p = &first_timeout; 
-  while (*p && (*p)->time <= time) p = &((*p)->next);
-  t->next = *p;
-  *p = t;
+  if (heap_size >= heap_alloc) {
+    heap_alloc = heap_alloc ? 2*heap_alloc : 32;
+    Timeout** h = new Timeout*[heap_alloc];
+    if (heap_size) memcpy(h, heap, heap_size*sizeof(Timeout*));
+    delete[] heap;
+    heap = h;
+  }
+  heap_set(heap_size++, t);
+  heap_fix(t->index);
+  timeout_hash_add(t);
 }
 
 /**
   Returns true if the timeout exists and has not been called yet.
 */
 int Fl::has_timeout(Fl_Timeout_Handler cb, void *argp) {
-  for (Timeout* t = first_timeout; t; t = t->next)
+  if (!heap_size) return 0;
+  for (Timeout* t = timeout_hash[timeout_hash_of(cb, argp)]; t; t = t->next)
     if (t->cb == cb && t->arg == argp) return 1;
   return 0;
 }
@@ -257,15 +373,23 @@ int Fl::has_timeout(Fl_Timeout_Handler cb, void *argp) {
 void Fl::remove_timeout(Fl_Timeout_Handler cb, void *argp) {
   // This version removes all matching timeouts, not just the first one.
   // This may change in the future.
-  for (Timeout** p = &first_timeout; *p;) {
+  if (!heap_size) return;
+  if (!argp) {
+    // any argument matches, so look at them all before removing any,
+    // which reorders the heap
+    Timeout** found = new Timeout*[heap_size];
+    int n = 0;
+    for (int i = 0; i < heap_size; i++)
+      if (heap[i]->cb == cb) found[n++] = heap[i];
+    while (n) unlink_timeout(found[--n]);
+    delete[] found;
+    return;
+  }
+  Timeout** p = &timeout_hash[timeout_hash_of(cb, argp)];
+  while (*p) {
     Timeout* t = *p;
-    if (t->cb == cb && (t->arg == argp || !argp)) {
-      *p = t->next;
-      t->next = free_timeout;
-      free_timeout = t;
-    } else {
-      p = &(t->next);
-    }
+    if (t->cb == cb && t->arg == argp) unlink_timeout(t);
+    else p = &(t->next);
   }
 }
 
@@ -420,26 +544,25 @@ double Fl::wait(double time_to_wait) {
 
 #else
 
-  if (first_timeout) {
+  if (heap_size) {
     elapse_timeouts();
     Timeout *t;
-    while ((t = first_timeout)) {
-      if (t->time > 0) break;
-      // The first timeout in the array has expired.
-      missed_timeout_by = t->time;
-      // We must remove timeout from array before doing the callback:
+    // call the expired timeouts, and those due within timeout_slack()
+    // so that they don't need a wakeup of their own.  Only timeouts that
+    // were there before this pass run early, or a timer shorter than the
+    // slack would be called again and again here:
+    unsigned long pass_seq = timeout_seq;
+    while (heap_size && ((t = heap[0])->time <= clock_now ||
+           (t->time <= clock_now + timeout_slack_ && t->seq < pass_seq))) {
+      missed_timeout_by = t->time - clock_now;
+      // We must remove timeout from heap before doing the callback:
       void (*cb)(void*) = t->cb;
       void *argp = t->arg;
-      first_timeout = t->next;
-      t->next = free_timeout;
-      free_timeout = t;
-      ++free_timeout_count;
-      --first_timeout_count;
+      unlink_timeout(t);
       // Now it is safe for the callback to do add_timeout:
       cb(argp);
+      missed_timeout_by = 0;
     }
-  } else {
-    reset_clock = 1; // we are not going to check the clock
   }
   run_checks();
 //  if (idle && !fl_ready()) {
@@ -452,8 +575,8 @@ double Fl::wait(double time_to_wait) {
     // the idle function may turn off idle, we can then wait:
     if (idle) time_to_wait = 0.0;
   }
-  if (first_timeout && first_timeout->time < time_to_wait)
-    time_to_wait = first_timeout->time;
+  if (heap_size && heap[0]->time - clock_now < time_to_wait)
+    time_to_wait = heap[0]->time - clock_now;
   if (time_to_wait <= 0.0) {
     // do flush second so that the results of events are visible:
     int ret = fl_wait(0.0);
@@ -572,11 +695,9 @@ int Fl::check() {
 */
 int Fl::ready() {
 #if ! defined( WIN32 )  &&  ! defined(__APPLE__)
-  if (first_timeout) {
+  if (heap_size) {
     elapse_timeouts();
-    if (first_timeout->time <= 0) return 1;
-  } else {
-    reset_clock = 1;
+    if (heap[0]->time <= clock_now) return 1;
   }
 #endif
   return fl_ready();
@@ -667,6 +788,7 @@ void Fl::redraw() {
 void Fl::flush() {
   if (damage()) {
     damage_ = 0;
+    widgets_drawn_ = pixels_copied_ = 0;
     for (Fl_X* i = Fl_X::first; i; i = i->next) {
       if (i->wait_for_expose) {damage_ = 1; continue;}
       Fl_Window* wi = i->w;
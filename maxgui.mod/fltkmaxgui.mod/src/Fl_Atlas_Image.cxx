@@ -0,0 +1,159 @@
+//
+// "$Id$"
+//
+// Image atlas code for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/Fl_Atlas_Image.H>
+
+/**
+  Creates an atlas holding a copy of the given pixels, with one
+  reference for the caller to release().
+*/
+Fl_Image_Atlas::Fl_Image_Atlas(const uchar *bits, int W, int H, int D, int LD) :
+  variants_(0), next_(0), color_(0), weight_(0), refs_(1) {
+  Fl_RGB_Image img(bits, W, H, D, LD);
+  image_ = (Fl_RGB_Image *)img.copy();
+}
+
+// Makes a variant of an atlas from its image, see variant().
+Fl_Image_Atlas::Fl_Image_Atlas(Fl_RGB_Image *img, Fl_Color c, float i) :
+  image_(img), variants_(0), next_(0), color_(c), weight_(i), refs_(0) {
+  if (i < 0) image_->desaturate();
+  else image_->color_average(c, i);
+}
+
+Fl_Image_Atlas::~Fl_Image_Atlas() {
+  while (variants_) {
+    Fl_Image_Atlas *v = variants_;
+    variants_ = v->next_;
+    delete v;
+  }
+  delete image_;
+}
+
+/**
+  Gives back a reference to the atlas, deleting it with its variants
+  and their server copies when it was the last one.
+*/
+void Fl_Image_Atlas::release() {
+  if (--refs_ <= 0) delete this;
+}
+
+/**
+  Returns the atlas with its colors blended with \p c like
+  Fl_Image::color_average(), making it the first time it is asked for.
+  The variant belongs to this atlas and lives as long as it does.
+*/
+Fl_Image_Atlas *Fl_Image_Atlas::variant(Fl_Color c, float i) {
+  if (i < 0.0f) i = 0.0f;
+  else if (i > 1.0f) i = 1.0f;
+  Fl_Image_Atlas *v;
+  for (v = variants_; v; v = v->next_)
+    if (v->weight_ == i && v->color_ == c) return v;
+  v = new Fl_Image_Atlas((Fl_RGB_Image *)image_->copy(), c, i);
+  v->next_ = variants_;
+  variants_ = v;
+  return v;
+}
+
+/**
+  Returns the atlas converted to grayscale like Fl_Image::desaturate(),
+  making it the first time it is asked for.
+*/
+Fl_Image_Atlas *Fl_Image_Atlas::desaturated() {
+  Fl_Image_Atlas *v;
+  for (v = variants_; v; v = v->next_)
+    if (v->weight_ < 0) return v;
+  v = new Fl_Image_Atlas((Fl_RGB_Image *)image_->copy(), 0, -1);
+  v->next_ = variants_;
+  variants_ = v;
+  return v;
+}
+
+/**
+  Creates an image of the \p W x \p H rectangle at \p X, \p Y of an
+  atlas, which must lie inside it.
+*/
+Fl_Atlas_Image::Fl_Atlas_Image(Fl_Image_Atlas *atlas, int X, int Y, int W, int H) :
+  Fl_RGB_Image(0, W, H, atlas->image()->d()), atlas_(atlas), strip_(0), x_(X), y_(Y) {
+  atlas_->reference();
+  strip(atlas);
+}
+
+Fl_Atlas_Image::~Fl_Atlas_Image() {
+  atlas_->release();
+}
+
+// Makes the image draw from s, which is atlas_ or one of its variants.
+void Fl_Atlas_Image::strip(Fl_Image_Atlas *s) {
+  Fl_RGB_Image *img = s->image();
+  strip_ = s;
+  d(img->d());
+  ld(img->w() * img->d());
+  array = img->array + y_ * ld() + x_ * d();
+}
+
+/**
+  Returns a copy of the image.  A copy of the same size shares the
+  atlas, any other is a new Fl_RGB_Image.
+*/
+Fl_Image *Fl_Atlas_Image::copy(int W, int H) {
+  if (W != w() || H != h()) return Fl_RGB_Image::copy(W, H);
+  Fl_Atlas_Image *img = new Fl_Atlas_Image(atlas_, x_, y_, W, H);
+  img->strip(strip_);
+  return img;
+}
+
+void Fl_Atlas_Image::color_average(Fl_Color c, float i) {
+  strip(strip_->variant(c, i));
+}
+
+void Fl_Atlas_Image::desaturate() {
+  if (d() < 3) return;
+  strip(strip_->desaturated());
+}
+
+void Fl_Atlas_Image::draw(int XP, int YP, int WP, int HP, int cx, int cy) {
+  // clip to the rectangle, the atlas image only clips to the atlas
+  if (cx < 0) {WP += cx; XP -= cx; cx = 0;}
+  if (cx+WP > w()) WP = w()-cx;
+  if (WP <= 0) return;
+  if (cy < 0) {HP += cy; YP -= cy; cy = 0;}
+  if (cy+HP > h()) HP = h()-cy;
+  if (HP <= 0) return;
+  strip_->image()->draw(XP, YP, WP, HP, cx + x_, cy + y_);
+}
+
+/**
+  Does nothing, the server copy belongs to the atlas and is shared by
+  all its images.
+*/
+void Fl_Atlas_Image::uncache() {
+}
+
+//
+// End of "$Id$".
+//
@@ -29,14 +29,16 @@
 #include <FL/Fl_Browser.H>
 #include <FL/fl_draw.H>
 #include "flstring.h"
+#include "Fl_Browser_Index.H"
 #include <stdlib.h>
+#include <ctype.h>
 #include <math.h>
 
 // I modified this from the original Forms data to use a linked list
 // so that the number of items in the browser and size of those items
-// is unlimited. The only problem is that the old browser used an
-// index number to identify a line, and it is slow to convert from/to
-// a pointer. I use a cache of the last match to try to speed this up.
+// is unlimited. The old browser used an index number to identify a
+// line, so the lines are also kept in an Fl_Browser_Index, which
+// converts between line numbers and lines in O(log n).
 
 // Also added the ability to "hide" a line. This sets its height to
 // zero, so the Fl_Browser_ cannot pick it.
@@ -44,21 +46,6 @@
 #define SELECTED 1
 #define NOTDISPLAYED 2
 
-// WARNING:
-//       Fl_File_Chooser.cxx also has a definition of this structure (FL_BLINE).
-//       Changes to FL_BLINE *must* be reflected in Fl_File_Chooser.cxx as well.
-//       This hack in Fl_File_Chooser should be solved.
-//
-struct FL_BLINE {	// data is in a linked list of these
-  FL_BLINE* prev;
-  FL_BLINE* next;
-  void* data;
-  Fl_Image* icon;
-  short length;		// sizeof(txt)-1, may be longer than string
-  char flags;		// selected, displayed
-  char txt[1];		// start of allocated array
-};
-
 /**
   Returns the very first item in the list.
   Example of use:
@@ -132,16 +119,76 @@ const char *Fl_Browser::item_text(void *item) const {
   return ((FL_BLINE*)item)->txt;
 }
 
+/**
+  Returns the user data for \p item.
+  \param[in] item The item whose data is returned.
+  \returns The item's data. (Can be NULL)
+*/
+void *Fl_Browser::item_data(void *item) const {
+  return ((FL_BLINE*)item)->data;
+}
+
+/**
+  Returns the text of one column of \p item, for sorting by column.
+  Columns are separated by column_char(), and the format codes at the
+  start of the column (see format_char()) are skipped.
+  \param[in] item The item whose text is returned.
+  \param[in] column The column (0 based).
+  \param[out] len The length of the column text.
+  \returns The start of the column text, or "" if there is no such column.
+*/
+const char *Fl_Browser::item_column(void *item, int column, int *len) const {
+  const char *s = ((FL_BLINE*)item)->txt;
+  for (; s && column > 0; column--) {
+    s = strchr(s, column_char());
+    if (s) s++;
+  }
+  if (!s) {*len = 0; return "";}
+  while (*s == format_char()) {
+    s++;
+    switch (*s++) {
+    case 'B': case 'C': case 'F': case 'S':
+      while (isdigit(*s & 255)) s++;
+      break;
+    case 0: case '@': s--;
+    case '.': goto END_FORMAT;
+    }
+  }
+  END_FORMAT:
+  const char *e = strchr(s, column_char());
+  *len = e ? e - s : strlen(s);
+  return s;
+}
+
+/**
+  Puts all the lines in the order given by \p items, by relinking them
+  and rebuilding the line index in one pass.
+  \param[in] items All the items of the browser, in their new order.
+  \param[in] n The number of items, which must be size().
+  \see Fl_Browser_::sort()
+*/
+void Fl_Browser::item_reorder(void **items, int n) {
+  FL_BLINE *prev = 0;
+  lineindex_->clear();
+  for (int i = 0; i < n; i++) {
+    FL_BLINE *l = (FL_BLINE*)items[i];
+    l->prev = prev;
+    if (prev) prev->next = l;
+    else first = l;
+    lineindex_->insert(i, l);
+    prev = l;
+  }
+  if (prev) prev->next = 0;
+  last = prev;
+}
+
 /**
   Returns the item for specified \p line.
 
-  Note: This call is slow. It's fine for e.g. responding to user
-  clicks, but slow if called often, such as in a tight sorting loop.
-  Finding an item 'by line' involves a linear lookup on the internal
-  linked list. The performance hit can be significant if the browser's
-  contents is large, and the method is called often (e.g. during a sort).
-  If you're writing a subclass, use the protected methods item_first(),
-  item_next(), etc. to access the internal linked list more efficiently.
+  Finding an item 'by line' is a lookup in an index of the lines, which
+  is O(log n). To visit all the items, it is still faster to use the
+  protected methods item_first(), item_next(), etc., which follow the
+  internal linked list.
 
   \param[in] line The line number of the item to return. (1 based)
   \retval item that was found.
@@ -149,20 +196,7 @@ const char *Fl_Browser::item_text(void *item) const {
   \see item_at(), find_line(), lineno()
 */
 FL_BLINE* Fl_Browser::find_line(int line) const {
-  int n; FL_BLINE* l;
-  if (line == cacheline) return cache;
-  if (cacheline && line > (cacheline/2) && line < ((cacheline+lines)/2)) {
-    n = cacheline; l = cache;
-  } else if (line <= (lines/2)) {
-    n = 1; l = first;
-  } else {
-    n = lines; l = last;
-  }
-  for (; n < line && l; n++) l = l->next;
-  for (; n > line && l; n--) l = l->prev;
-  ((Fl_Browser*)this)->cacheline = line;
-  ((Fl_Browser*)this)->cache = l;
-  return l;
+  return lineindex_->at(line-1);
 }
 
 /**
@@ -175,28 +209,7 @@ FL_BLINE* Fl_Browser::find_line(int line) const {
 int Fl_Browser::lineno(void *item) const {
   FL_BLINE* l = (FL_BLINE*)item;
   if (!l) return 0;
-  if (l == cache) return cacheline;
-  if (l == first) return 1;
-  if (l == last) return lines;
-  if (!cache) {
-    ((Fl_Browser*)this)->cache = first;
-    ((Fl_Browser*)this)->cacheline = 1;
-  }
-  // assume it is near cache, search both directions:
-  FL_BLINE* b = cache->prev;
-  int bnum = cacheline-1;
-  FL_BLINE* f = cache->next;
-  int fnum = cacheline+1;
-  int n = 0;
-  for (;;) {
-    if (b == l) {n = bnum; break;}
-    if (f == l) {n = fnum; break;}
-    if (b) {b = b->prev; bnum--;}
-    if (f) {f = f->next; fnum++;}
-  }
-  ((Fl_Browser*)this)->cache = l;
-  ((Fl_Browser*)this)->cacheline = n;
-  return n;
+  return lineindex_->index_of(l)+1;
 }
 
 /**
@@ -211,10 +224,9 @@ FL_BLINE* Fl_Browser::_remove(int line) {
   FL_BLINE* ttt = find_line(line);
   deleting(ttt);
 
-  cacheline = line-1;
-  cache = ttt->prev;
+  uncount_line(ttt);
+  lineindex_->remove(line-1);
   lines--;
-  full_height_ -= item_height(ttt);
   if (ttt->prev) ttt->prev->next = ttt->next;
   else first = ttt->next;
   if (ttt->next) ttt->next->prev = ttt->prev;
@@ -267,10 +279,9 @@ void Fl_Browser::insert(int line, FL_BLINE* item) {
     item->prev->next = item;
     n->prev = item;
   }
-  cacheline = line;
-  cache = item;
+  lineindex_->insert(line <= 1 ? 0 : line > lines ? lines : line-1, item);
   lines++;
-  full_height_ += item_height(item);
+  count_line(item);
   redraw_line(item);
 }
 
@@ -292,6 +303,7 @@ void Fl_Browser::insert(int line, const char* newtext, void* d) {
   FL_BLINE* t = (FL_BLINE*)malloc(sizeof(FL_BLINE)+l);
   t->length = (short)l;
   t->flags = 0;
+  t->height = t->width = -1;
   strcpy(t->txt, newtext);
   t->data = d;
   t->icon = 0;
@@ -323,11 +335,12 @@ void Fl_Browser::move(int to, int from) {
 void Fl_Browser::text(int line, const char* newtext) {
   if (line < 1 || line > lines) return;
   FL_BLINE* t = find_line(line);
+  uncount_line(t);
   int l = strlen(newtext);
   if (l > t->length) {
     FL_BLINE* n = (FL_BLINE*)malloc(sizeof(FL_BLINE)+l);
     replacing(t, n);
-    cache = n;
+    lineindex_->set(line-1, n);
     n->data = t->data;
     n->icon = t->icon;
     n->length = (short)l;
@@ -340,6 +353,8 @@ void Fl_Browser::text(int line, const char* newtext) {
     t = n;
   }
   strcpy(t->txt, newtext);
+  t->height = t->width = -1;
+  count_line(t);
   redraw_line(t);
 }
 
@@ -357,6 +372,8 @@ void Fl_Browser::data(int line, void* d) {
 /**
   Returns height of \p item in pixels.
   This takes into account embedded \@ codes within the text() label.
+  The height is measured once and kept with the line until its text,
+  its icon or the browser's text font or size change.
   \param[in] item The item whose height is returned.
   \returns The height of the item in pixels.
   \see item_height(), item_width(),\n
@@ -365,7 +382,13 @@ void Fl_Browser::data(int line, void* d) {
 int Fl_Browser::item_height(void *item) const {
   FL_BLINE* l = (FL_BLINE*)item;
   if (l->flags & NOTDISPLAYED) return 0;
+  check_sizes();
+  if (l->height < 0) l->height = measure_height(l);
+  return l->height;
+}
 
+// Measures the height of line l, ignoring whether it is hidden:
+int Fl_Browser::measure_height(FL_BLINE* l) const {
   int hmax = 2; // use 2 to insure we don't return a zero!
 
   if (!l->txt[0]) {
@@ -417,6 +440,7 @@ int Fl_Browser::item_height(void *item) const {
 /**
   Returns width of \p item in pixels.
   This takes into account embedded \@ codes within the text() label.
+  Like item_height(), the width is measured once and then kept with the line.
   \param[in] item The item whose width is returned.
   \returns The width of the item in pixels.
   \see item_height(), item_width(),\n
@@ -424,6 +448,13 @@ int Fl_Browser::item_height(void *item) const {
 */
 int Fl_Browser::item_width(void *item) const {
   FL_BLINE* l=(FL_BLINE*)item;
+  check_sizes();
+  if (l->width < 0) l->width = measure_width(l);
+  return l->width;
+}
+
+// Measures the width of line l:
+int Fl_Browser::measure_width(FL_BLINE* l) const {
   char* str = l->txt;
   const int* i = column_widths();
   int ww = 0;
@@ -475,18 +506,117 @@ int Fl_Browser::item_width(void *item) const {
   return ww + int(fl_width(str)) + 6;
 }
 
+/*
+  The sizes of the lines are totalled in full_height_, full_width_ and
+  odd_lines_, which are updated by count_line() and uncount_line() as
+  lines are added, removed, changed, hidden or shown.  The totals are only
+  kept once something has asked for them (sized_ is set); until then,
+  such as while a large list is being filled, nothing is measured at all.
+*/
+
+// Forgets the measured size of every line, after something changed
+// that affects all of them:
+void Fl_Browser::invalidate_sizes() {
+  for (FL_BLINE* l = first; l; l = l->next) l->height = l->width = -1;
+  sized_font_ = textfont();
+  sized_size_ = textsize();
+  sized_ = 0;
+}
+
+// There is no hook for textfont() and textsize() changes, so notice them here:
+void Fl_Browser::check_sizes() const {
+  if (textfont() != sized_font_ || textsize() != sized_size_)
+    ((Fl_Browser*)this)->invalidate_sizes();
+}
+
+// Computes the totals from scratch:
+void Fl_Browser::count_lines() const {
+  check_sizes();
+  if (sized_) return;
+  Fl_Browser* b = (Fl_Browser*)this;
+  fl_font(textfont(), textsize());
+  b->line_height_ = fl_height() > 2 ? fl_height() : 2;
+  b->full_height_ = 0;
+  b->full_width_ = -1;
+  b->odd_lines_ = 0;
+  for (FL_BLINE* l = first; l; l = l->next) {
+    int hh = item_height(l);
+    b->full_height_ += hh;
+    if (hh != line_height_) b->odd_lines_++;
+  }
+  b->sized_ = 1;
+}
+
+// Adds the size of line l to the totals:
+void Fl_Browser::count_line(FL_BLINE* l) {
+  check_sizes();
+  if (!sized_) return;
+  int hh = item_height(l);
+  full_height_ += hh;
+  if (hh != line_height_) odd_lines_++;
+  if (full_width_ >= 0 && !(l->flags & NOTDISPLAYED)) {
+    int ww = item_width(l);
+    if (ww > full_width_) full_width_ = ww;
+  }
+}
+
+// Removes the size of line l from the totals:
+void Fl_Browser::uncount_line(FL_BLINE* l) {
+  check_sizes();
+  if (!sized_) return;
+  int hh = item_height(l);
+  full_height_ -= hh;
+  if (hh != line_height_) odd_lines_--;
+  // removing the widest line means finding the next widest one:
+  if (full_width_ >= 0 && !(l->flags & NOTDISPLAYED) && item_width(l) >= full_width_)
+    full_width_ = -1;
+}
+
 /**
   The height of the entire list of all visible() items in pixels.
   This returns the accumulated height of *all* the items in the browser
   that are not hidden with hide(), including items scrolled off screen.
+  The total is kept up to date as lines change, so this is fast.
   \returns The accumulated size of all the visible items in pixels.
   \see item_height(), item_width(),\n
        incr_height(), full_height()
 */
 int Fl_Browser::full_height() const {
+  count_lines();
   return full_height_;
 }
 
+/**
+  The width of the widest visible() item in pixels.
+  \returns The width of the widest item in pixels.
+  \see item_height(), item_width(),\n
+       incr_height(), full_height()
+*/
+int Fl_Browser::full_width() const {
+  count_lines();
+  if (full_width_ < 0) {
+    int ww = 0;
+    for (FL_BLINE* l = first; l; l = l->next) {
+      if (l->flags & NOTDISPLAYED) continue;
+      int w1 = item_width(l);
+      if (w1 > ww) ww = w1;
+    }
+    ((Fl_Browser*)this)->full_width_ = ww;
+  }
+  return full_width_;
+}
+
+/**
+  Returns the height of every item if all of them are visible and equally
+  high, which is the case for lists of plain text without icons, or 0
+  if they are not.
+  \see Fl_Browser_::item_uniform_height()
+*/
+int Fl_Browser::item_uniform_height() const {
+  count_lines();
+  return (lines && !odd_lines_) ? line_height_ : 0;
+}
+
 /**
   The default 'average' item height (including inter-item spacing) in pixels.
   This currently returns textsize() + 2.
@@ -607,10 +737,24 @@ Fl_Browser::Fl_Browser(int X, int Y, int W, int H, const char *L)
   column_widths_ = no_columns;
   lines = 0;
   full_height_ = 0;
-  cacheline = 0;
+  full_width_ = -1;
+  odd_lines_ = 0;
+  line_height_ = 0;
+  sized_ = 0;
+  sized_font_ = textfont();
+  sized_size_ = textsize();
   format_char_ = '@';
   column_char_ = '\t';
-  first = last = cache = 0;
+  first = last = 0;
+  lineindex_ = new Fl_Browser_Index;
+}
+
+/**
+  The destructor deletes all list items and destroys the browser.
+*/
+Fl_Browser::~Fl_Browser() {
+  clear();
+  delete lineindex_;
 }
 
 /**
@@ -624,11 +768,17 @@ void Fl_Browser::lineposition(int line, Fl_Line_Position pos) {
   if (line>lines) line = lines;
   int p = 0;
 
-  FL_BLINE* l;
-  for (l=first; l && line>1; l = l->next) {
-    line--; p += item_height(l);
+  int hh = item_uniform_height();
+  if (hh) {
+    p = (line-1)*hh;
+    if (pos == BOTTOM) p += hh;
+  } else {
+    FL_BLINE* l;
+    for (l=first; l && line>1; l = l->next) {
+      line--; p += item_height(l);
+    }
+    if (l && (pos == BOTTOM)) p += item_height (l);
   }
-  if (l && (pos == BOTTOM)) p += item_height (l);
 
   int final = p, X, Y, W, H;
   bbox(X, Y, W, H);
@@ -662,7 +812,11 @@ void Fl_Browser::clear() {
     free(l);
     l = n;
   }
+  lineindex_->clear();
   full_height_ = 0;
+  full_width_ = -1;
+  odd_lines_ = 0;
+  sized_ = 0;
   first = 0;
   last = 0;
   lines = 0;
@@ -746,8 +900,9 @@ int Fl_Browser::selected(int line) const {
 void Fl_Browser::show(int line) {
   FL_BLINE* t = find_line(line);
   if (t->flags & NOTDISPLAYED) {
+    uncount_line(t);
     t->flags &= ~NOTDISPLAYED;
-    full_height_ += item_height(t);
+    count_line(t);
     if (Fl_Browser_::displayed(t)) redraw();
   }
 }
@@ -764,8 +919,9 @@ void Fl_Browser::show(int line) {
 void Fl_Browser::hide(int line) {
   FL_BLINE* t = find_line(line);
   if (!(t->flags & NOTDISPLAYED)) {
-    full_height_ -= item_height(t);
+    uncount_line(t);
     t->flags |= NOTDISPLAYED;
+    count_line(t);
     if (Fl_Browser_::displayed(t)) redraw();
   }
 }
@@ -811,6 +967,10 @@ void Fl_Browser::swap(FL_BLINE *a, FL_BLINE *b) {
 
   if ( a == b || !a || !b) return;          // nothing to do
   swapping(a, b);
+  int aline = lineindex_->index_of(a);
+  int bline = lineindex_->index_of(b);
+  lineindex_->set(aline, b);
+  lineindex_->set(bline, a);
   FL_BLINE *aprev  = a->prev;
   FL_BLINE *anext  = a->next;
   FL_BLINE *bprev  = b->prev;
@@ -841,9 +1001,6 @@ void Fl_Browser::swap(FL_BLINE *a, FL_BLINE *b) {
      if ( bprev ) bprev->next = a; else first = a;
      a->next = bnext;
   }
-  // Disable cache -- we played around with positions
-  cacheline = 0;
-  cache = 0;
 }
 
 /**
@@ -873,16 +1030,13 @@ void Fl_Browser::icon(int line, Fl_Image* icon) {
 
   FL_BLINE* bl = find_line(line);
 
-  int old_h = bl->icon ? bl->icon->h()+2 : 0;	// init with *old* icon height
-  bl->icon = 0;					// remove icon, if any
-  int th = item_height(bl);			// height of text only
-  int new_h = icon ? icon->h()+2 : 0;		// init with *new* icon height
-  if (th > old_h) old_h = th;
-  if (th > new_h) new_h = th;
-  int dh = new_h - old_h;
-  full_height_ += dh;				// do this *always*
-
+  int old_h = item_height(bl);
+  uncount_line(bl);
   bl->icon = icon;				// set new icon
+  bl->height = bl->width = -1;			// and measure the line again
+  count_line(bl);
+  int dh = item_height(bl) - old_h;
+
   if (dh>0) {
     redraw();					// icon larger than item? must redraw widget
   } else {
@@ -28,10 +28,14 @@
 #define DISPLAY_SEARCH_BOTH_WAYS_AT_ONCE
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "flstring.h"
 #include <FL/Fl.H>
 #include <FL/Fl_Widget.H>
 #include <FL/Fl_Browser_.H>
 #include <FL/fl_draw.H>
+#include <FL/fl_utf8.h>
 
 
 // This is the base class for browsers.  To be useful it must be
@@ -144,6 +148,15 @@ void Fl_Browser_::update_top() {
     void* l;
     int ly;
     int yy = position_;
+    // with rows of equal height the top item is known directly:
+    int uh = item_uniform_height();
+    if (uh > 0 && (l = item_at(yy/uh + 1)) != 0) {
+      top_ = l;
+      offset_ = yy%uh;
+      real_position_ = yy;
+      damage(FL_DAMAGE_SCROLL);
+      return;
+    }
     // start from either head or current position, whichever is closer:
     if (!top_ || yy <= (real_position_/2)) {
       l = item_first();
@@ -986,51 +999,179 @@ Fl_Browser_::Fl_Browser_(int X, int Y, int W, int H, const char* L)
   end();
 }
 
+// Sorting: the items are copied into an array together with their sort
+// keys, merge sorted (which keeps equal items in their current order)
+// and handed back to the subclass in one call to item_reorder().
+
+struct Fl_Browser_Sort_Key {
+  void *item;
+  void *data;
+  const char *text;
+  int len;		// length of the column text, -1 for the whole item
+};
+
+struct Fl_Browser_Sort_Order {
+  Fl_Browser_Sort_Compare *cmp;
+  void *arg;
+  int flags;
+};
+
+// Compares two strings according to the FL_SORT_CASEINSENSITIVE and
+// FL_SORT_NUMERIC flags.  Runs of digits are compared like numericsort.c
+// does for file names, other characters by Unicode code point.
+static int sort_compare_text(const char *a, const char *b, int flags) {
+  if (!(flags & (FL_SORT_CASEINSENSITIVE|FL_SORT_NUMERIC))) return strcmp(a, b);
+  const char *ae = a + strlen(a);
+  const char *be = b + strlen(b);
+  for (;;) {
+    if ((flags & FL_SORT_NUMERIC) && isdigit(*a & 255) && isdigit(*b & 255)) {
+      int diff, magdiff;
+      while (*a == '0') a++;
+      while (*b == '0') b++;
+      while (isdigit(*a & 255) && *a == *b) {a++; b++;}
+      diff = (isdigit(*a & 255) && isdigit(*b & 255)) ? *a - *b : 0;
+      magdiff = 0;
+      while (isdigit(*a & 255)) {magdiff++; a++;}
+      while (isdigit(*b & 255)) {magdiff--; b++;}
+      if (magdiff) return magdiff;	// compare # of significant digits
+      if (diff) return diff;		// compare first non-zero digit
+      continue;
+    }
+    if (!*a || !*b) return (*a & 255) - (*b & 255);
+    unsigned ca, cb;
+    if (flags & FL_SORT_CASEINSENSITIVE) {
+      int la, lb;
+      ca = fl_tolower(fl_utf8decode(a, ae, &la)); a += la;
+      cb = fl_tolower(fl_utf8decode(b, be, &lb)); b += lb;
+    } else {
+      ca = *a++ & 255;
+      cb = *b++ & 255;
+    }
+    if (ca != cb) return ca < cb ? -1 : 1;
+  }
+}
+
+static int sort_compare(const Fl_Browser_Sort_Key *a, const Fl_Browser_Sort_Key *b,
+                        const Fl_Browser_Sort_Order *o) {
+  int r;
+  if (o->cmp) r = o->cmp(a->text, a->data, b->text, b->data, o->arg);
+  else r = sort_compare_text(a->text, b->text, o->flags);
+  return (o->flags & FL_SORT_DESCENDING) ? -r : r;
+}
+
+// Bottom-up merge sort of k[0..n-1], using tmp[] as scratch space.
+// Returns whichever of the two arrays holds the result.
+static Fl_Browser_Sort_Key *sort_keys(Fl_Browser_Sort_Key *k, Fl_Browser_Sort_Key *tmp, int n,
+                                      const Fl_Browser_Sort_Order *o) {
+  for (int width = 1; width < n; width *= 2) {
+    for (int lo = 0; lo < n; lo += 2*width) {
+      int mid = lo + width, hi = lo + 2*width;
+      if (mid > n) mid = n;
+      if (hi > n) hi = n;
+      int i = lo, j = mid, d = lo;
+      // already in order (common when re-sorting a sorted list):
+      if (mid < hi && sort_compare(k+mid-1, k+mid, o) <= 0) i = hi;
+      while (i < mid && j < hi) {
+        if (sort_compare(k+j, k+i, o) < 0) tmp[d++] = k[j++];
+        else tmp[d++] = k[i++];
+      }
+      if (i == hi) {
+        memcpy(tmp+lo, k+lo, (hi-lo)*sizeof(Fl_Browser_Sort_Key));
+        continue;
+      }
+      while (i < mid) tmp[d++] = k[i++];
+      while (j < hi) tmp[d++] = k[j++];
+    }
+    Fl_Browser_Sort_Key *t = k; k = tmp; tmp = t;
+  }
+  return k;
+}
+
 /**
   Sort the items in the browser based on \p flags.
-  item_swap(void*, void*) and item_text(void*) must be implemented for this call.
+  item_text(void*) must be implemented for this call, and either
+  item_reorder(void**, int) or item_swap(void*, void*).
   \param[in] flags FL_SORT_ASCENDING -- sort in ascending order\n
                    FL_SORT_DESCENDING -- sort in descending order\n
-		   Values other than the above will cause undefined behavior\n
+                   FL_SORT_CASEINSENSITIVE -- ignore case\n
+                   FL_SORT_NUMERIC -- compare numbers in the text by value\n
 		   Other flags may appear in the future.
-  \todo Add a flag to ignore case
+  \see sort(int, int, Fl_Browser_Sort_Compare*, void*)
 */
 void Fl_Browser_::sort(int flags) {
-  //
-  // Simple bubble sort - pure lazyness on my side.
-  //
-  int i, j, n = -1, desc = ((flags&FL_SORT_DESCENDING)==FL_SORT_DESCENDING);
-  void *a =item_first(), *b, *c;
-  if (!a) return;
-  while (a) {
-    a = item_next(a);
-    n++;
+  sort(flags, -1, 0, 0);
+}
+
+/**
+  Sort the items in the browser by one column of their text, or with
+  a user supplied comparison function.
+
+  The sort is stable, items that compare equal keep their order, and
+  takes O(n log n) comparisons.  The items are put in their new order
+  with a single call to item_reorder().
+
+  \param[in] flags FL_SORT_ASCENDING, FL_SORT_DESCENDING,
+                   FL_SORT_CASEINSENSITIVE and FL_SORT_NUMERIC as for
+                   sort(int).  Only FL_SORT_DESCENDING is used if \p cmp
+                   is given.
+  \param[in] column Column to sort by, as returned by item_column() (0 based),
+                   or -1 to compare the whole item_text().
+  \param[in] cmp   Optional comparison function.  It is passed the texts
+                   being compared and the item_data() of their items.
+  \param[in] arg   Passed to \p cmp.
+*/
+void Fl_Browser_::sort(int flags, int column, Fl_Browser_Sort_Compare *cmp, void *arg) {
+  int i, n = 0, pool = 0, top = -1;
+  void *item;
+  for (item = item_first(); item; item = item_next(item)) n++;
+  if (n < 2) return;
+
+  Fl_Browser_Sort_Key *keys = (Fl_Browser_Sort_Key*)malloc(2*n*sizeof(Fl_Browser_Sort_Key));
+  for (i = 0, item = item_first(); item; item = item_next(item), i++) {
+    Fl_Browser_Sort_Key *k = keys + i;
+    k->item = item;
+    k->data = item_data(item);
+    if (column < 0) {
+      k->text = item_text(item);
+      k->len = -1;
+      if (!k->text) k->text = "";
+    } else {
+      k->text = item_column(item, column, &k->len);
+      pool += k->len + 1;
+    }
+    if (item == top_) top = i;
   }
-  for (i=n; i>0; i--) {
-    char swapped = 0;
-    a = item_first();
-    b = item_next(a);
-    for (j=0; j<i; j++) {
-      const char *ta = item_text(a);
-      const char *tb = item_text(b);
-      c = item_next(b);
-      if (desc) {
-        if (strcmp(ta, tb)<0) {
-          item_swap(a, b);
-          swapped = 1;
-        }
-      } else {
-        if (strcmp(ta, tb)>0) {
-          item_swap(a, b);
-          swapped = 1;
-        }
-      }
-      if (!c) break;
-      b = c; a = item_prev(b);
+
+  // column texts are not terminated, so copy them out:
+  char *buf = 0;
+  if (pool) {
+    char *p = buf = (char*)malloc(pool);
+    for (i = 0; i < n; i++) {
+      memcpy(p, keys[i].text, keys[i].len);
+      p[keys[i].len] = 0;
+      keys[i].text = p;
+      p += keys[i].len + 1;
     }
-    if (!swapped)
-      break;
   }
+
+  Fl_Browser_Sort_Order o;
+  o.cmp = cmp;
+  o.arg = arg;
+  o.flags = flags;
+  Fl_Browser_Sort_Key *sorted = sort_keys(keys, keys + n, n, &o);
+
+  void **items = (void**)malloc(n*sizeof(void*));
+  for (i = 0; i < n; i++) items[i] = sorted[i].item;
+  void *sel = selection_;
+  item_reorder(items, n);
+  // keep the view where it was, and the selection on the same item:
+  if (top >= 0) top_ = items[top];
+  selection_ = sel;
+  redraw_lines();
+
+  free(items);
+  free(buf);
+  free(keys);
 }
 
 // Default versions of some of the virtual functions:
@@ -1102,6 +1243,44 @@ void Fl_Browser_::item_select(void *item, int val) {}
 */
 int Fl_Browser_::item_selected(void* item) const { return item==selection_ ? 1 : 0; }
 
+/**
+  This method may be provided by the subclass to return the text of one
+  column of \p item, used by sort() when sorting by column.  The returned
+  text need not be terminated; its length is returned in \p len.
+  The default implementation splits item_text() at tab characters.
+  \param[in] item The item whose text is returned.
+  \param[in] column The column (0 based).
+  \param[out] len The length of the column text.
+  \returns The start of the column text, or "" if there is no such column.
+*/
+const char *Fl_Browser_::item_column(void *item, int column, int *len) const {
+  const char *s = item_text(item);
+  for (; s && column > 0; column--) {
+    s = strchr(s, '\t');
+    if (s) s++;
+  }
+  if (!s) {*len = 0; return "";}
+  const char *e = strchr(s, '\t');
+  *len = e ? e - s : strlen(s);
+  return s;
+}
+
+/**
+  This method may be provided by the subclass to put all the items in the
+  order given by \p items, as sort() does.  The default implementation
+  moves every item into place with item_swap(), which takes at most
+  \p n - 1 swaps.
+  \param[in] items All the items of the browser, in their new order.
+  \param[in] n The number of items.
+*/
+void Fl_Browser_::item_reorder(void **items, int n) {
+  void *p = item_first();
+  for (int i = 0; i < n && p; i++) {
+    if (p != items[i]) item_swap(p, items[i]);
+    p = item_next(items[i]);
+  }
+}
+
 //
 // End of "$Id: Fl_Browser_.cxx 7115 2010-02-20 17:40:07Z AlbrechtS $".
 //
@@ -0,0 +1,232 @@
+//
+// "$Id$"
+//
+// Line index for Fl_Browser.
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <stdlib.h>
+#include "flstring.h"
+#include "Fl_Browser_Index.H"
+
+/*
+ Blocks are never empty.  A full block is split in two halves before a
+ line is added to it, and a block that shrinks is merged with its
+ successor when both fit into half a block, so the number of blocks stays
+ proportional to the number of lines.  Whenever the number of blocks
+ changes the Fenwick tree is rebuilt, which is O(number of blocks) and
+ rare compared to the edits that only adjust one block.
+ */
+
+#define BLOCK_LINES 256
+
+struct Fl_Browser_Block {
+  int n;                        // lines in this block
+  int index;                    // position of this block in blocks_
+  FL_BLINE *line[BLOCK_LINES];
+};
+
+Fl_Browser_Index::Fl_Browser_Index()
+{
+  blocks_ = 0;
+  fw_ = 0;
+  nblocks_ = ablocks_ = 0;
+  size_ = 0;
+}
+
+Fl_Browser_Index::~Fl_Browser_Index()
+{
+  clear();
+  free(blocks_);
+  free(fw_);
+}
+
+/** Removes all lines from the index.  The lines themselves are not freed. */
+void Fl_Browser_Index::clear()
+{
+  for (int b = 0; b < nblocks_; b++)
+    free(blocks_[b]);
+  nblocks_ = 0;
+  size_ = 0;
+}
+
+void Fl_Browser_Index::rebuild_()
+{
+  int i;
+  for (i = 1; i <= nblocks_; i++) {
+    blocks_[i-1]->index = i-1;
+    fw_[i] = blocks_[i-1]->n;
+  }
+  for (i = 1; i <= nblocks_; i++) {
+    int j = i + (i & -i);
+    if (j <= nblocks_) fw_[j] += fw_[i];
+  }
+}
+
+void Fl_Browser_Index::fw_add_(int b, int d)
+{
+  for (int i = b+1; i <= nblocks_; i += i & -i)
+    fw_[i] += d;
+}
+
+// Returns the number of lines in the blocks before block b.
+int Fl_Browser_Index::prefix_(int b) const
+{
+  int s = 0;
+  for (int i = b; i > 0; i -= i & -i)
+    s += fw_[i];
+  return s;
+}
+
+// Returns the block holding line i and the offset of the line in it.
+int Fl_Browser_Index::find_(int i, int *off) const
+{
+  int b = 0, step = 1;
+  while (2*step <= nblocks_) step *= 2;
+  for (; step; step /= 2) {
+    if (b + step <= nblocks_ && fw_[b + step] <= i) {
+      b += step;
+      i -= fw_[b];
+    }
+  }
+  *off = i;
+  return b;
+}
+
+void Fl_Browser_Index::insert_block_(int b, Fl_Browser_Block *blk)
+{
+  if (nblocks_ == ablocks_) {
+    ablocks_ = ablocks_ ? 2*ablocks_ : 16;
+    blocks_ = (Fl_Browser_Block **)realloc(blocks_, ablocks_*sizeof(Fl_Browser_Block *));
+    fw_ = (int *)realloc(fw_, (ablocks_+1)*sizeof(int));
+  }
+  memmove(blocks_+b+1, blocks_+b, (nblocks_-b)*sizeof(Fl_Browser_Block *));
+  blocks_[b] = blk;
+  nblocks_++;
+  rebuild_();
+}
+
+void Fl_Browser_Index::remove_block_(int b)
+{
+  free(blocks_[b]);
+  memmove(blocks_+b, blocks_+b+1, (nblocks_-b-1)*sizeof(Fl_Browser_Block *));
+  nblocks_--;
+  rebuild_();
+}
+
+/** Returns line \p i (0 based), or NULL if \p i is out of range. */
+FL_BLINE *Fl_Browser_Index::at(int i) const
+{
+  if (i < 0 || i >= size_)
+    return 0;
+  int off;
+  int b = find_(i, &off);
+  return blocks_[b]->line[off];
+}
+
+/** Returns the position (0 based) of line \p l, which must be in the index. */
+int Fl_Browser_Index::index_of(const FL_BLINE *l) const
+{
+  const Fl_Browser_Block *blk = l->block;
+  int off = 0;
+  while (blk->line[off] != l) off++;
+  return prefix_(blk->index) + off;
+}
+
+/** Inserts \p l so that it becomes line \p i (0 based). */
+void Fl_Browser_Index::insert(int i, FL_BLINE *l)
+{
+  if (i < 0) i = 0;
+  if (i > size_) i = size_;
+  int b, off;
+  if (!nblocks_) {
+    Fl_Browser_Block *blk = (Fl_Browser_Block *)malloc(sizeof(Fl_Browser_Block));
+    blk->n = 0;
+    insert_block_(0, blk);
+    b = off = 0;
+  } else if (i == size_) {
+    b = nblocks_-1;
+    off = blocks_[b]->n;
+  } else
+    b = find_(i, &off);
+
+  Fl_Browser_Block *blk = blocks_[b];
+  if (blk->n == BLOCK_LINES) {
+    Fl_Browser_Block *nb = (Fl_Browser_Block *)malloc(sizeof(Fl_Browser_Block));
+    int half = BLOCK_LINES/2;
+    nb->n = BLOCK_LINES - half;
+    memcpy(nb->line, blk->line+half, nb->n*sizeof(FL_BLINE *));
+    for (int k = 0; k < nb->n; k++) nb->line[k]->block = nb;
+    blk->n = half;
+    insert_block_(b+1, nb);
+    if (off > half) {
+      b++;
+      off -= half;
+      blk = nb;
+    }
+  }
+  memmove(blk->line+off+1, blk->line+off, (blk->n-off)*sizeof(FL_BLINE *));
+  blk->line[off] = l;
+  blk->n++;
+  l->block = blk;
+  fw_add_(b, 1);
+  size_++;
+}
+
+/** Removes line \p i (0 based) from the index. */
+void Fl_Browser_Index::remove(int i)
+{
+  if (i < 0 || i >= size_)
+    return;
+  int off;
+  int b = find_(i, &off);
+  Fl_Browser_Block *blk = blocks_[b];
+  memmove(blk->line+off, blk->line+off+1, (blk->n-off-1)*sizeof(FL_BLINE *));
+  blk->n--;
+  size_--;
+  if (!blk->n) {
+    remove_block_(b);
+    return;
+  }
+  fw_add_(b, -1);
+  if (b+1 < nblocks_ && blk->n + blocks_[b+1]->n <= BLOCK_LINES/2) {
+    Fl_Browser_Block *next = blocks_[b+1];
+    memcpy(blk->line+blk->n, next->line, next->n*sizeof(FL_BLINE *));
+    for (int k = 0; k < next->n; k++) next->line[k]->block = blk;
+    blk->n += next->n;
+    remove_block_(b+1);
+  }
+}
+
+/** Replaces line \p i (0 based) by \p l. */
+void Fl_Browser_Index::set(int i, FL_BLINE *l)
+{
+  int off;
+  int b = find_(i, &off);
+  blocks_[b]->line[off] = l;
+  l->block = blocks_[b];
+}
+
+//
+// End of "$Id$".
+//
@@ -31,6 +31,7 @@
 #include <FL/Fl_Printer.H>
 #include <FL/x.H>
 #include <FL/fl_draw.H>
+#include <stdlib.h>
 
 // On systems that support double buffering "naturally" the base
 // Fl_Window class will probably do double-buffer and this subclass
@@ -67,9 +68,26 @@ void Fl_Double_Window::show() {
 
 #if defined(USE_X11)
 
-// maybe someone feels inclined to implement alpha blending on X11?
+#if HAVE_XRENDER
+#  include <X11/extensions/Xrender.h>
+#endif
+
+// Images with alpha are composited with XRender where the server has it,
+// see Fl_RGB_Image, and blended by reading the window back otherwise.
 char fl_can_do_alpha_blending() {
+#if HAVE_XRENDER
+  static char been_here = 0;
+  static char can_do = 0;
+  if (been_here) return can_do;
+  been_here = 1;
+  fl_open_display();
+  int event_base, error_base;
+  can_do = XRenderQueryExtension(fl_display, &event_base, &error_base) &&
+           XRenderFindStandardFormat(fl_display, PictStandardARGB32) != 0;
+  return can_do;
+#else
   return 0;
+#endif
 }
 #elif defined(WIN32)
 
@@ -254,6 +272,58 @@ extern void fl_restore_clip();
 # error unsupported platform
 #endif
 
+#if defined(USE_X11)
+#  include <X11/Xregion.h>
+#endif
+
+// Regions made of more rectangles than this are copied as their
+// bounding box, which is cheaper than that many separate copies:
+static const int MAX_COPY_RECTS = 32;
+
+static void copy_rect(Fl_X *myi, int W0, int H0, int X, int Y, int W, int H) {
+  if (X < 0) {W += X; X = 0;}
+  if (Y < 0) {H += Y; Y = 0;}
+  if (W > W0-X) W = W0-X;
+  if (H > H0-Y) H = H0-Y;
+  if (W <= 0 || H <= 0) return;
+  fl_copy_offscreen(X, Y, W, H, myi->other_xid, X, Y);
+  Fl::pixels_copied_ += W*H;
+}
+
+// Copies the rectangles of region r from the back buffer to the window,
+// or the part inside the current clip if r is 0:
+static void copy_region(Fl_X *myi, int W0, int H0, Fl_Region r) {
+  if (r) {
+#if defined(USE_X11)
+    REGION *xr = (REGION*)r;
+    if (xr->numRects <= MAX_COPY_RECTS) {
+      for (long i = 0; i < xr->numRects; i++) {
+        BOX &b = xr->rects[i];
+        copy_rect(myi, W0, H0, b.x1, b.y1, b.x2-b.x1, b.y2-b.y1);
+      }
+      return;
+    }
+#elif defined(WIN32)
+    DWORD size = GetRegionData(r, 0, NULL);
+    RGNDATA *data = size ? (RGNDATA*)malloc(size) : 0;
+    if (data && GetRegionData(r, size, data) &&
+        data->rdh.nCount <= (DWORD)MAX_COPY_RECTS) {
+      RECT *rects = (RECT*)data->Buffer;
+      for (DWORD i = 0; i < data->rdh.nCount; i++)
+        copy_rect(myi, W0, H0, rects[i].left, rects[i].top,
+                  rects[i].right-rects[i].left, rects[i].bottom-rects[i].top);
+      free(data);
+      return;
+    }
+    free(data);
+#endif
+  }
+  // on Irix (at least) it is faster to reduce the area copied to
+  // the current clip region:
+  int X,Y,W,H; fl_clip_box(0,0,W0,H0,X,Y,W,H);
+  copy_rect(myi, W0, H0, X, Y, W, H);
+}
+
 /**
   Forces the window to be redrawn.
 */
@@ -313,8 +383,10 @@ void Fl_Double_Window::flush(int eraseoverlay) {
     s.swap_action = XdbeCopied;
     XdbeSwapBuffers(fl_display, &s, 1);
     return;
-  } else
+  }
 #endif
+  // the damaged area, where the back buffer is copied to the window:
+  Fl_Region r;
   if (damage() & ~FL_DAMAGE_EXPOSE) {
     fl_clip_region(myi->region); myi->region = 0;
 #ifdef WIN32
@@ -343,12 +415,17 @@ void Fl_Double_Window::flush(int eraseoverlay) {
     draw();
     fl_window = myi->xid;
 #endif
+    // the clip stack owns the region now and draw() may have replaced
+    // and freed it, so copy whatever clip it left:
+    r = fl_clip_region();
+  } else {
+    r = myi->region;
   }
-  if (eraseoverlay) fl_clip_region(0);
-  // on Irix (at least) it is faster to reduce the area copied to
-  // the current clip region:
-  int X,Y,W,H; fl_clip_box(0,0,w(),h(),X,Y,W,H);
-  if (myi->other_xid) fl_copy_offscreen(X, Y, W, H, myi->other_xid, X, Y);
+  if (eraseoverlay) {fl_clip_region(0); r = 0;}
+#if defined(__APPLE_QUARTZ__)
+  r = 0; // the offscreen was drawn without the damage region
+#endif
+  if (myi->other_xid) copy_region(myi, w(), h(), r);
 }
 
 void Fl_Double_Window::resize(int X,int Y,int W,int H) {
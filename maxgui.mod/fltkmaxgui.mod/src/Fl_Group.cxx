@@ -714,6 +714,7 @@ void Fl_Group::update_child(Fl_Widget& widget) const {
       fl_not_clipped(widget.x(), widget.y(), widget.w(), widget.h())) {
     widget.draw();	
     widget.clear_damage();
+    Fl::widgets_drawn_++;
   }
 }
 
@@ -729,6 +730,7 @@ void Fl_Group::draw_child(Fl_Widget& widget) const {
     widget.clear_damage(FL_DAMAGE_ALL);
     widget.draw();
     widget.clear_damage();
+    Fl::widgets_drawn_++;
   }
 }
 
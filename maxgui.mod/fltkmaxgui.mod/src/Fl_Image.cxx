@@ -25,6 +25,7 @@
 //     http://www.fltk.org/str.php
 //
 
+#include <config.h>
 #include <FL/Fl.H>
 #include <FL/fl_draw.H>
 #include <FL/x.H>
@@ -32,6 +33,13 @@
 #include <FL/Fl_Menu_Item.H>
 #include <FL/Fl_Image.H>
 #include "flstring.h"
+#include "fl_simd.H"
+#include <stdlib.h>
+#include <math.h>
+
+#if !defined(WIN32) && !defined(__APPLE__) && HAVE_XRENDER
+#  include <X11/extensions/Xrender.h>
+#endif
 
 #ifdef WIN32
 void fl_release_dc(HWND, HDC); // from Fl_win32.cxx
@@ -186,6 +194,12 @@ void Fl_RGB_Image::uncache() {
   }
 #else
   if (id_) {
+#if !defined(WIN32) && HAVE_XRENDER
+    // images with alpha are cached as an XRender picture, see alpha_picture()
+    if (d() == 2 || d() == 4)
+      XRenderFreePicture(fl_display, (Picture)id_);
+    else
+#endif
     fl_delete_offscreen((Fl_Offscreen)id_);
     id_ = 0;
   }
@@ -197,7 +211,196 @@ void Fl_RGB_Image::uncache() {
 #endif
 }
 
+Fl_RGB_Scaling Fl_RGB_Image::scaling_ = FL_RGB_SCALING_NEAREST;
+
+/**
+  Creates a copy of the image, resized to \p W x \p H with the
+  algorithm set by RGB_scaling().
+*/
 Fl_Image *Fl_RGB_Image::copy(int W, int H) {
+  return copy(W, H, scaling_);
+}
+
+// The resampling filters, as functions of the distance from the
+// center of the output pixel in (scaled) source pixels:
+static double box_filter(double x) {
+  return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+}
+
+static double triangle_filter(double x) {
+  if (x < 0) x = -x;
+  return x < 1 ? 1 - x : 0;
+}
+
+static double cubic_filter(double x) {
+  const double a = -0.5;
+  if (x < 0) x = -x;
+  if (x < 1) return ((a + 2) * x - (a + 3)) * x * x + 1;
+  if (x < 2) return (((x - 5) * x + 8) * x - 4) * a;
+  return 0;
+}
+
+// Computes for each of the dst output pixels of one axis the first of
+// the source pixels it is made of (first), how many there are (count)
+// and their weights in 1/16384ths (maxtaps per output pixel).  Returns
+// maxtaps.  Shrinking averages every source pixel under the output one,
+// enlarging interpolates between the nearest ones.
+static int resample_taps(int src, int dst, Fl_RGB_Scaling scaling,
+                         int *&first, int *&count, short *&weights) {
+  double scale = (double)src / dst;
+  double (*filter)(double) = box_filter;
+  double support = 0.5;
+  double fscale = scale > 1 ? scale : 1;
+  if (scale <= 1) {
+    if (scaling == FL_RGB_SCALING_BICUBIC) {filter = cubic_filter; support = 2;}
+    else {filter = triangle_filter; support = 1;}
+  }
+  support *= fscale;
+  int maxtaps = (int)ceil(support) * 2 + 1;
+  first = new int[dst];
+  count = new int[dst];
+  weights = new short[dst * maxtaps];
+  double *fw = new double[maxtaps];
+  for (int i = 0; i < dst; i++) {
+    double center = (i + 0.5) * scale;
+    int x0 = (int)(center - support + 0.5), x1 = (int)(center + support + 0.5);
+    if (x0 < 0) x0 = 0;
+    if (x1 > src) x1 = src;
+    if (x1 - x0 > maxtaps) x1 = x0 + maxtaps;
+    double sum = 0;
+    int n = 0;
+    for (int x = x0; x < x1; x++, n++)
+      sum += fw[n] = filter((x - center + 0.5) / fscale);
+    short *w = weights + i * maxtaps;
+    if (sum == 0) {
+      // can only happen at the very edge, use the nearest pixel
+      x0 = (int)center;
+      if (x0 >= src) x0 = src - 1;
+      n = 1;
+      w[0] = 16384;
+    } else {
+      int total = 0, big = 0;
+      for (int k = 0; k < n; k++) {
+        w[k] = (short)floor(fw[k] / sum * 16384 + 0.5);
+        total += w[k];
+        if (w[k] > w[big]) big = k;
+      }
+      w[big] += 16384 - total; // so that a flat color stays the same
+    }
+    first[i] = x0;
+    count[i] = n;
+  }
+  delete[] fw;
+  return maxtaps;
+}
+
+// Resizes the image with separable filters: each output row is first
+// filtered vertically from the source rows into a row of the source
+// width, which is then filtered horizontally.  Images with alpha are
+// filtered premultiplied, so that the color of transparent pixels does
+// not bleed into the edges of the opaque ones.
+Fl_Image *Fl_RGB_Image::resample_(int W, int H, Fl_RGB_Scaling scaling) {
+  int D = d();
+  int line_d = ld() ? ld() : w() * D;
+  const uchar *src_array = array;
+  uchar *premul = 0;
+  if (D == 2 || D == 4) {
+    premul = new uchar[w() * h() * D];
+    uchar *q = premul;
+    for (int y = 0; y < h(); y++) {
+      const uchar *p = array + y * line_d;
+      for (int x = w(); x > 0; x--, p += D, q += D) {
+        int a = p[D - 1];
+        for (int c = 0; c < D - 1; c++) q[c] = (p[c] * a + 127) / 255;
+        q[D - 1] = a;
+      }
+    }
+    src_array = premul;
+    line_d = w() * D;
+  }
+  int *xfirst, *xcount, *yfirst, *ycount;
+  short *xweights, *yweights;
+  int xtaps = resample_taps(w(), W, scaling, xfirst, xcount, xweights);
+  int ytaps = resample_taps(h(), H, scaling, yfirst, ycount, yweights);
+
+  uchar *new_array = new uchar[W * H * D];
+  Fl_RGB_Image *new_image = new Fl_RGB_Image(new_array, W, H, D);
+  new_image->alloc_array = 1;
+
+  int len = w() * D;
+  uchar *tmp = new uchar[len];
+  const uchar **rows = new const uchar *[ytaps];
+#if FL_SIMD
+  int simd = fl_simd_available();
+#endif
+  uchar *new_ptr = new_array;
+  for (int dy = 0; dy < H; dy++) {
+    int n = ycount[dy];
+    const short *yw = yweights + dy * ytaps;
+    const uchar *row;
+    if (n == 1 && yw[0] == 16384) {
+      row = src_array + yfirst[dy] * line_d;
+    } else {
+      for (int k = 0; k < n; k++) rows[k] = src_array + (yfirst[dy] + k) * line_d;
+      int i = 0;
+#if FL_SIMD
+      if (simd) i = fl_simd_filter_rows(rows, yw, n, tmp, len);
+#endif
+      for (; i < len; i++) {
+        int v = 1 << 13;
+        for (int k = 0; k < n; k++) v += rows[k][i] * yw[k];
+        v >>= 14;
+        tmp[i] = v < 0 ? 0 : v > 255 ? 255 : v;
+      }
+      row = tmp;
+    }
+    int dx = 0;
+#if FL_SIMD
+    if (simd) {
+      dx = fl_simd_filter_pixels(row, xfirst, xcount, xweights, xtaps, new_ptr, W, D);
+      new_ptr += dx * D;
+    }
+#endif
+    for (; dx < W; dx++) {
+      const uchar *src = row + xfirst[dx] * D;
+      const short *xw = xweights + dx * xtaps;
+      int m = xcount[dx];
+      for (int c = 0; c < D; c++) {
+        int v = 1 << 13;
+        for (int k = 0; k < m; k++) v += src[k * D + c] * xw[k];
+        v >>= 14;
+        *new_ptr++ = v < 0 ? 0 : v > 255 ? 255 : v;
+      }
+    }
+  }
+
+  if (premul) {
+    uchar *p = new_array;
+    for (int i = W * H; i > 0; i--, p += D) {
+      int a = p[D - 1];
+      for (int c = 0; c < D - 1; c++) {
+        if (!a) p[c] = 0;
+        else if (a < 255) {
+          int v = (p[c] * 255 + a / 2) / a;
+          p[c] = v > 255 ? 255 : v;
+        }
+      }
+    }
+    delete[] premul;
+  }
+
+  delete[] rows;
+  delete[] tmp;
+  delete[] xfirst; delete[] xcount; delete[] xweights;
+  delete[] yfirst; delete[] ycount; delete[] yweights;
+  return new_image;
+}
+
+/**
+  Creates a copy of the image, resized to \p W x \p H with the given
+  algorithm regardless of RGB_scaling().
+*/
+Fl_Image *Fl_RGB_Image::copy(int W, int H, Fl_RGB_Scaling scaling) {
   Fl_RGB_Image	*new_image;	// New RGB image
   uchar		*new_array;	// New array for image data
 
@@ -227,6 +430,7 @@ Fl_Image *Fl_RGB_Image::copy(int W, int H) {
     } else return new Fl_RGB_Image(array, w(), h(), d(), ld());
   }
   if (W <= 0 || H <= 0) return 0;
+  if (scaling != FL_RGB_SCALING_NEAREST) return resample_(W, H, scaling);
 
   // OK, need to resize the image data; allocate memory and 
   uchar		*new_ptr;	// Pointer into new array
@@ -389,12 +593,25 @@ static void alpha_blend(Fl_RGB_Image *img, int X, int Y, int W, int H, int cx, i
 
   uchar srcr, srcg, srcb, srca;
   uchar dstr, dstg, dstb, dsta;
+#if FL_SIMD
+  int simd = fl_simd_available();
+  // the vector loop does the start of each row, the loops below the rest
+#  define SIMD_BLEND(x) \
+  if (simd) { \
+    int n = fl_simd_blend(srcptr, dstptr, W, img->d()); \
+    srcptr += n * img->d(); dstptr += n * 3; x -= n; \
+  }
+#else
+#  define SIMD_BLEND(x)
+#endif
 
   if (img->d() == 2) {
     // Composite grayscale + alpha over RGB...
     // Composite RGBA over RGB...
-    for (int y = H; y > 0; y--, srcptr+=srcskip)
-      for (int x = W; x > 0; x--) {
+    for (int y = H; y > 0; y--, srcptr+=srcskip) {
+      int x = W;
+      SIMD_BLEND(x)
+      for (; x > 0; x--) {
 	srcg = *srcptr++;
 	srca = *srcptr++;
 
@@ -407,10 +624,13 @@ static void alpha_blend(Fl_RGB_Image *img, int X, int Y, int W, int H, int cx, i
 	*dstptr++ = (srcg * srca + dstg * dsta) >> 8;
 	*dstptr++ = (srcg * srca + dstb * dsta) >> 8;
       }
+    }
   } else {
     // Composite RGBA over RGB...
-    for (int y = H; y > 0; y--, srcptr+=srcskip)
-      for (int x = W; x > 0; x--) {
+    for (int y = H; y > 0; y--, srcptr+=srcskip) {
+      int x = W;
+      SIMD_BLEND(x)
+      for (; x > 0; x--) {
 	srcr = *srcptr++;
 	srcg = *srcptr++;
 	srcb = *srcptr++;
@@ -425,12 +645,82 @@ static void alpha_blend(Fl_RGB_Image *img, int X, int Y, int W, int H, int cx, i
 	*dstptr++ = (srcg * srca + dstg * dsta) >> 8;
 	*dstptr++ = (srcb * srca + dstb * dsta) >> 8;
       }
+    }
   }
+#undef SIMD_BLEND
 
   fl_draw_image(dst, X, Y, W, H, 3, 0);
 
   delete[] dst;
 }
+
+#if HAVE_XRENDER
+// Returns the ARGB32 picture format if the server has the Render
+// extension, or 0 if images with alpha must be blended by alpha_blend().
+// The extension is only queried once.
+static XRenderPictFormat *argb_format() {
+  static int checked = 0;
+  static XRenderPictFormat *format = 0;
+  if (!checked) {
+    int event_base, error_base;
+    if (XRenderQueryExtension(fl_display, &event_base, &error_base))
+      format = XRenderFindStandardFormat(fl_display, PictStandardARGB32);
+    checked = 1;
+  }
+  return format;
+}
+
+// Uploads an image with alpha to the server once, as a premultiplied
+// ARGB picture that XRender can composite without reading the window back.
+static Picture alpha_picture(Fl_RGB_Image *img) {
+  XRenderPictFormat *format = argb_format();
+  if (!format) return 0;
+  int w = img->w(), h = img->h(), d = img->d();
+  int ld = img->ld() ? img->ld() : w * d;
+  unsigned *buf = (unsigned *)malloc(w * h * sizeof(unsigned));
+  unsigned *dst = buf;
+  for (int y = 0; y < h; y++) {
+    const uchar *src = (const uchar *)img->array + y * ld;
+    for (int x = 0; x < w; x++, src += d) {
+      unsigned r, g, b, a;
+      if (d == 2) {r = g = b = src[0]; a = src[1];}
+      else {r = src[0]; g = src[1]; b = src[2]; a = src[3];}
+      r = (r * a + 127) / 255;
+      g = (g * a + 127) / 255;
+      b = (b * a + 127) / 255;
+      *dst++ = (a << 24) | (r << 16) | (g << 8) | b;
+    }
+  }
+  Pixmap pixmap = XCreatePixmap(fl_display, RootWindow(fl_display, fl_screen), w, h, 32);
+  XImage *ximage = XCreateImage(fl_display, fl_visual->visual, 32, ZPixmap, 0,
+                                (char *)buf, w, h, 32, 0);
+  // buf is in host byte order, let Xlib swap it if the server differs
+  static const int one = 1;
+  ximage->byte_order = *(const char *)&one ? LSBFirst : MSBFirst;
+  GC gc = XCreateGC(fl_display, pixmap, 0, 0);
+  XPutImage(fl_display, pixmap, gc, ximage, 0, 0, 0, 0, w, h);
+  XFreeGC(fl_display, gc);
+  XDestroyImage(ximage); // also frees buf
+  Picture pict = XRenderCreatePicture(fl_display, pixmap, format, 0, 0);
+  XFreePixmap(fl_display, pixmap); // the picture keeps the pixmap alive
+  return pict;
+}
+
+// Composites the cached picture of an image over the current drawable,
+// honouring the current clip region.  Returns 0 if the drawable's
+// visual has no picture format, so the caller can blend by hand.
+static int alpha_composite(Picture src, int X, int Y, int W, int H, int cx, int cy) {
+  XRenderPictFormat *format = XRenderFindVisualFormat(fl_display, fl_visual->visual);
+  if (!format) return 0;
+  Picture dst = XRenderCreatePicture(fl_display, fl_window, format, 0, 0);
+  Fl_Region r = fl_clip_region();
+  if (r) XRenderSetPictureClipRegion(fl_display, dst, r);
+  XRenderComposite(fl_display, PictOpOver, src, None, dst,
+                   cx, cy, 0, 0, X, Y, W, H);
+  XRenderFreePicture(fl_display, dst);
+  return 1;
+}
+#endif // HAVE_XRENDER
 #endif // !WIN32 && !__APPLE_QUARTZ__
 
 void Fl_RGB_Image::draw(int XP, int YP, int WP, int HP, int cx, int cy) {
@@ -545,7 +835,17 @@ void Fl_Xlib_Graphics_Driver::draw(Fl_RGB_Image *img, int XP, int YP, int WP, in
       fl_draw_image(img->array, 0, 0, img->w(), img->h(), img->d(), img->ld());
       fl_end_offscreen();
     }
+#if HAVE_XRENDER
+    else img->id_ = alpha_picture(img);
+#endif
+  }
+#if HAVE_XRENDER
+  if (img->id_ && (img->d() == 2 || img->d() == 4)) {
+    if (!alpha_composite((Picture)img->id_, X, Y, W, H, cx, cy))
+      alpha_blend(img, X, Y, W, H, cx, cy);
+    return;
   }
+#endif
   if (img->id_) {
     if (img->mask_) {
       // I can't figure out how to combine a mask with existing region,
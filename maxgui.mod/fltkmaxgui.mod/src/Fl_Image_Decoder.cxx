@@ -0,0 +1,485 @@
+//
+// "$Id$"
+//
+// PNG and JPEG decoding for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/Fl_Image_Decoder.H>
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+#include <FL/fl_utf8.h>
+#include "flstring.h"
+
+// Some releases of the Cygwin JPEG libraries don't have a correctly
+// updated header file for the INT32 data type; the following define
+// from Shane Hill seems to be a usable workaround...
+
+#if defined(WIN32) && defined(__CYGWIN__)
+#  define XMD_H
+#endif // WIN32 && __CYGWIN__
+
+extern "C"
+{
+#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
+#  include <zlib.h>
+#  ifdef HAVE_PNG_H
+#    include <png.h>
+#  else
+#    include <libpng/png.h>
+#  endif // HAVE_PNG_H
+#endif // HAVE_LIBPNG && HAVE_LIBZ
+#ifdef HAVE_LIBJPEG
+#  include <jpeglib.h>
+#endif // HAVE_LIBJPEG
+}
+
+// number of rows decoded between two calls of the callback
+#define DECODE_BATCH 16
+
+Fl_Image_Decoder::Fl_Image_Decoder() {
+  callback_ = 0;
+  user_data_ = 0;
+  max_w_ = max_h_ = 0;
+  rows_ = 0;
+  arows_ = 0;
+  jpeg_ = 0;
+  reported_ = 0;
+}
+
+// Gives img a cleared W x H x D array and returns pointers to its rows.
+unsigned char **Fl_Image_Decoder::start(Fl_RGB_Image *img, int W, int H, int D) {
+  img->uncache();
+  if (img->alloc_array) delete[] (uchar *)img->array;
+  uchar *array = new uchar[W * H * D];
+  memset(array, 0, W * H * D);
+  img->array = array;
+  img->alloc_array = 1;
+  img->w(W);
+  img->h(H);
+  img->d(D);
+  img->ld(0);
+  if (H > arows_) {
+    delete[] rows_;
+    arows_ = H;
+    rows_ = new uchar *[arows_];
+  }
+  for (int i = 0; i < H; i++)
+    rows_[i] = array + i * W * D;
+  return rows_;
+}
+
+// Leaves img empty after a decoding error.
+void Fl_Image_Decoder::fail(Fl_RGB_Image *img) {
+  img->uncache();
+  if (img->alloc_array) delete[] (uchar *)img->array;
+  img->array = 0;
+  img->alloc_array = 0;
+  img->w(0);
+  img->h(0);
+  img->d(0);
+  // tell a callback that holds on to the image that it is gone
+  if (reported_ && callback_) callback_(img, 0, 0, user_data_);
+  reported_ = 0;
+}
+
+void Fl_Image_Decoder::progress(Fl_RGB_Image *img, int y, int h) {
+  if (!callback_ || h <= 0) return;
+  img->uncache();
+  reported_ = 1;
+  callback_(img, y, h, user_data_);
+}
+
+////////////////////////////////////////////////////////////////
+// PNG
+
+#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
+struct fl_png_memory {
+  const unsigned char *data;
+  int size;
+  int pos;
+};
+
+extern "C" {
+  static void fl_png_read_memory(png_structp pp, png_bytep out, png_size_t n) {
+    fl_png_memory *m = (fl_png_memory *)png_get_io_ptr(pp);
+    if (n > (png_size_t)(m->size - m->pos)) png_error(pp, "Truncated PNG data");
+    memcpy(out, m->data + m->pos, n);
+    m->pos += (int)n;
+  }
+}
+#endif // HAVE_LIBPNG && HAVE_LIBZ
+
+int Fl_Image_Decoder::read_png(Fl_RGB_Image *img, void *fp, const unsigned char *data,
+                               int size, const char *name) {
+#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
+  png_structp	pp;			// PNG read pointer
+  png_infop	info;			// PNG info pointers
+  fl_png_memory	mem;			// memory source
+  int		channels;		// Number of color channels
+
+  pp = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (!pp) {
+    fail(img);
+    return 0;
+  }
+  info = png_create_info_struct(pp);
+  if (!info) {
+    png_destroy_read_struct(&pp, NULL, NULL);
+    fail(img);
+    return 0;
+  }
+
+  if (setjmp(png_jmpbuf(pp)))
+  {
+    Fl::warning("PNG file \"%s\" contains errors!\n", name);
+    png_destroy_read_struct(&pp, &info, NULL);
+    fail(img);
+    return 0;
+  }
+
+  if (fp) {
+    png_init_io(pp, (FILE *)fp);
+  } else {
+    mem.data = data;
+    mem.size = size;
+    mem.pos = 0;
+    png_set_read_fn(pp, &mem, fl_png_read_memory);
+  }
+
+  // Get the image dimensions and convert to grayscale or RGB...
+  png_read_info(pp, info);
+
+  int color_type = png_get_color_type(pp, info);
+  int bit_depth = png_get_bit_depth(pp, info);
+
+  if (color_type == PNG_COLOR_TYPE_PALETTE)
+    png_set_expand(pp);
+
+  if (color_type & PNG_COLOR_MASK_COLOR)
+    channels = 3;
+  else
+    channels = 1;
+
+  if ((color_type & PNG_COLOR_MASK_ALPHA) || png_get_valid(pp, info, PNG_INFO_tRNS))
+    channels ++;
+
+  if (bit_depth < 8)
+  {
+    png_set_packing(pp);
+    png_set_expand(pp);
+  }
+  else if (bit_depth == 16)
+    png_set_strip_16(pp);
+
+#  if defined(HAVE_PNG_GET_VALID) && defined(HAVE_PNG_SET_TRNS_TO_ALPHA)
+  // Handle transparency...
+  if (png_get_valid(pp, info, PNG_INFO_tRNS))
+    png_set_tRNS_to_alpha(pp);
+#  endif // HAVE_PNG_GET_VALID && HAVE_PNG_SET_TRNS_TO_ALPHA
+
+  int W = (int)png_get_image_width(pp, info);
+  int H = (int)png_get_image_height(pp, info);
+  int passes = png_set_interlace_handling(pp);
+  png_bytep *rows = start(img, W, H, channels);
+
+  if (passes > 1) {
+    // Interlaced: every pass fills the whole image with blocks of the
+    // pixels read so far, so each one can be shown as a coarser preview
+    for (int i = 0; i < passes; i ++) {
+      png_read_rows(pp, NULL, rows, H);
+      progress(img, 0, H);
+    }
+  } else {
+    for (int y = 0; y < H; y += DECODE_BATCH) {
+      int n = H - y < DECODE_BATCH ? H - y : DECODE_BATCH;
+      png_read_rows(pp, rows + y, NULL, n);
+      progress(img, y, n);
+    }
+  }
+
+#ifdef WIN32
+  // Some Windows graphics drivers don't honor transparency when RGB == white
+  if (channels == 4) {
+    // Convert RGB to 0 when alpha == 0...
+    uchar *ptr = (uchar *)img->array;
+    for (int i = W * H; i > 0; i --, ptr += 4)
+      if (!ptr[3]) ptr[0] = ptr[1] = ptr[2] = 0;
+  }
+#endif // WIN32
+
+  png_read_end(pp, info);
+  png_destroy_read_struct(&pp, &info, NULL);
+  return 1;
+#else
+  fail(img);
+  return 0;
+#endif // HAVE_LIBPNG && HAVE_LIBZ
+}
+
+////////////////////////////////////////////////////////////////
+// JPEG
+
+#ifdef HAVE_LIBJPEG
+// The decompressor is kept between images together with its error
+// handler and a data source that reads either a file or memory.
+struct fl_jpeg_context {
+  jpeg_decompress_struct	dinfo;	// Decompressor info
+  jpeg_error_mgr		pub_;	// Error handler info
+  jmp_buf			errhand_;
+  jpeg_source_mgr		src;
+  FILE				*fp;	// file to read, or 0 for memory
+  JOCTET			buffer[4096];
+};
+
+extern "C" {
+  static void fl_jpeg_error_handler(j_common_ptr dinfo) {
+    longjmp(((fl_jpeg_context *)dinfo)->errhand_, 1);
+  }
+
+  static void fl_jpeg_output_handler(j_common_ptr) {
+  }
+
+  static void fl_jpeg_init_source(j_decompress_ptr) {
+  }
+
+  static boolean fl_jpeg_fill_input_buffer(j_decompress_ptr dinfo) {
+    static const JOCTET eoi[2] = {0xFF, JPEG_EOI};
+    fl_jpeg_context *c = (fl_jpeg_context *)dinfo;
+    size_t n = c->fp ? fread(c->buffer, 1, sizeof(c->buffer), c->fp) : 0;
+    if (n > 0) {
+      c->src.next_input_byte = c->buffer;
+      c->src.bytes_in_buffer = n;
+    } else {
+      // out of data, end the image cleanly as libjpeg suggests
+      c->src.next_input_byte = eoi;
+      c->src.bytes_in_buffer = 2;
+    }
+    return TRUE;
+  }
+
+  static void fl_jpeg_skip_input_data(j_decompress_ptr dinfo, long n) {
+    fl_jpeg_context *c = (fl_jpeg_context *)dinfo;
+    while (n > (long)c->src.bytes_in_buffer) {
+      n -= (long)c->src.bytes_in_buffer;
+      fl_jpeg_fill_input_buffer(dinfo);
+    }
+    if (n > 0) {
+      c->src.next_input_byte += n;
+      c->src.bytes_in_buffer -= n;
+    }
+  }
+
+  static void fl_jpeg_term_source(j_decompress_ptr) {
+  }
+}
+#endif // HAVE_LIBJPEG
+
+int Fl_Image_Decoder::read_jpeg(Fl_RGB_Image *img, void *fp, const unsigned char *data, int size) {
+#ifdef HAVE_LIBJPEG
+  fl_jpeg_context *c = (fl_jpeg_context *)jpeg_;
+  if (!c) {
+    c = new fl_jpeg_context;
+    c->dinfo.err             = jpeg_std_error(&c->pub_);
+    c->pub_.error_exit       = fl_jpeg_error_handler;
+    c->pub_.output_message   = fl_jpeg_output_handler;
+    jpeg_create_decompress(&c->dinfo);
+    c->src.init_source       = fl_jpeg_init_source;
+    c->src.fill_input_buffer = fl_jpeg_fill_input_buffer;
+    c->src.skip_input_data   = fl_jpeg_skip_input_data;
+    c->src.resync_to_restart = jpeg_resync_to_restart;
+    c->src.term_source       = fl_jpeg_term_source;
+    jpeg_ = c;
+  }
+  // the error handler finds the context from the decompressor
+  c->dinfo.err = &c->pub_;
+  jpeg_decompress_struct *dinfo = &c->dinfo;
+
+  c->fp = (FILE *)fp;
+  c->src.next_input_byte = fp ? c->buffer : data;
+  c->src.bytes_in_buffer = fp ? 0 : size;
+  dinfo->src = &c->src;
+
+  if (setjmp(c->errhand_))
+  {
+    // returns the decompressor to its idle state for the next image
+    jpeg_abort_decompress(dinfo);
+    fail(img);
+    return 0;
+  }
+
+  jpeg_read_header(dinfo, TRUE);
+
+  dinfo->quantize_colors      = (boolean)FALSE;
+  dinfo->out_color_space      = JCS_RGB;
+  dinfo->out_color_components = 3;
+  dinfo->output_components    = 3;
+
+  // decode at the smallest fraction of the size that is still big enough
+  dinfo->scale_num   = 1;
+  dinfo->scale_denom = 1;
+  if (max_w_ > 0 || max_h_ > 0) {
+    for (int denom = 8; denom > 1; denom /= 2) {
+      int sw = (int)(dinfo->image_width + denom - 1) / denom;
+      int sh = (int)(dinfo->image_height + denom - 1) / denom;
+      if (sw >= max_w_ && sh >= max_h_) {
+        dinfo->scale_denom = denom;
+        break;
+      }
+    }
+  }
+
+  // show each scan of a progressive file as it arrives
+  int buffered = callback_ && jpeg_has_multiple_scans(dinfo);
+  dinfo->buffered_image = (boolean)buffered;
+
+  jpeg_calc_output_dimensions(dinfo);
+
+  int W = dinfo->output_width, H = dinfo->output_height;
+  JSAMPROW *rows = (JSAMPROW *)start(img, W, H, dinfo->output_components);
+
+  jpeg_start_decompress(dinfo);
+
+  int final_pass = 1;
+  do {
+    if (buffered) {
+      // read the rest of the current scan, then show what we have
+      int ret;
+      do ret = jpeg_consume_input(dinfo);
+      while (ret != JPEG_REACHED_SOS && ret != JPEG_REACHED_EOI && ret != JPEG_SUSPENDED);
+      final_pass = jpeg_input_complete(dinfo);
+      jpeg_start_output(dinfo, dinfo->input_scan_number);
+    }
+    int done = 0;
+    while (dinfo->output_scanline < dinfo->output_height) {
+      int y = dinfo->output_scanline;
+      jpeg_read_scanlines(dinfo, rows + y, (JDIMENSION)(H - y));
+      if (!buffered && (int)dinfo->output_scanline - done >= DECODE_BATCH) {
+        progress(img, done, dinfo->output_scanline - done);
+        done = dinfo->output_scanline;
+      }
+    }
+    if (buffered) {
+      jpeg_finish_output(dinfo);
+      progress(img, 0, H);
+    } else {
+      progress(img, done, H - done);
+    }
+  } while (!final_pass);
+
+  jpeg_finish_decompress(dinfo);
+  return 1;
+#else
+  fail(img);
+  return 0;
+#endif // HAVE_LIBJPEG
+}
+
+Fl_Image_Decoder::~Fl_Image_Decoder() {
+#ifdef HAVE_LIBJPEG
+  if (jpeg_) {
+    jpeg_destroy_decompress(&((fl_jpeg_context *)jpeg_)->dinfo);
+    delete (fl_jpeg_context *)jpeg_;
+  }
+#endif // HAVE_LIBJPEG
+  delete[] rows_;
+}
+
+////////////////////////////////////////////////////////////////
+
+/** Decodes the PNG file \p filename into \p img.  Returns 0 on failure. */
+int Fl_Image_Decoder::png(Fl_RGB_Image *img, const char *filename) {
+  reported_ = 0;
+  FILE *fp = fl_fopen(filename, "rb");
+  if (!fp) {
+    fail(img);
+    return 0;
+  }
+  int ok = read_png(img, fp, 0, 0, filename);
+  fclose(fp);
+  return ok;
+}
+
+/** Decodes \p size bytes of PNG data into \p img.  Returns 0 on failure. */
+int Fl_Image_Decoder::png(Fl_RGB_Image *img, const unsigned char *data, int size) {
+  reported_ = 0;
+  return read_png(img, 0, data, size, "(memory)");
+}
+
+/** Decodes the JPEG file \p filename into \p img.  Returns 0 on failure. */
+int Fl_Image_Decoder::jpeg(Fl_RGB_Image *img, const char *filename) {
+  reported_ = 0;
+  FILE *fp = fl_fopen(filename, "rb");
+  if (!fp) {
+    fail(img);
+    return 0;
+  }
+  int ok = read_jpeg(img, fp, 0, 0);
+  fclose(fp);
+  return ok;
+}
+
+/** Decodes \p size bytes of JPEG data into \p img.  Returns 0 on failure. */
+int Fl_Image_Decoder::jpeg(Fl_RGB_Image *img, const unsigned char *data, int size) {
+  reported_ = 0;
+  return read_jpeg(img, 0, data, size);
+}
+
+/** Decodes the PNG file \p filename into a new image, or returns NULL. */
+Fl_RGB_Image *Fl_Image_Decoder::png(const char *filename) {
+  Fl_RGB_Image *img = new Fl_RGB_Image(0, 0, 0);
+  if (png(img, filename)) return img;
+  delete img;
+  return 0;
+}
+
+/** Decodes \p size bytes of PNG data into a new image, or returns NULL. */
+Fl_RGB_Image *Fl_Image_Decoder::png(const unsigned char *data, int size) {
+  Fl_RGB_Image *img = new Fl_RGB_Image(0, 0, 0);
+  if (png(img, data, size)) return img;
+  delete img;
+  return 0;
+}
+
+/** Decodes the JPEG file \p filename into a new image, or returns NULL. */
+Fl_RGB_Image *Fl_Image_Decoder::jpeg(const char *filename) {
+  Fl_RGB_Image *img = new Fl_RGB_Image(0, 0, 0);
+  if (jpeg(img, filename)) return img;
+  delete img;
+  return 0;
+}
+
+/** Decodes \p size bytes of JPEG data into a new image, or returns NULL. */
+Fl_RGB_Image *Fl_Image_Decoder::jpeg(const unsigned char *data, int size) {
+  Fl_RGB_Image *img = new Fl_RGB_Image(0, 0, 0);
+  if (jpeg(img, data, size)) return img;
+  delete img;
+  return 0;
+}
+
+//
+// End of "$Id$".
+//
@@ -28,31 +28,15 @@
 // Contents:
 
 //
-//   Fl_PNG_Image::Fl_PNG_Image() - Load a PNG image file.
+//   Fl_PNG_Image::Fl_PNG_Image() - Load a PNG image file or data.
 //
 
 //
 // Include necessary header files...
 //
 
-#include <FL/Fl.H>
 #include <FL/Fl_PNG_Image.H>
-#include <config.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <FL/fl_utf8.h>
-
-extern "C"
-{
-#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
-#  include <zlib.h>
-#  ifdef HAVE_PNG_H
-#    include <png.h>
-#  else
-#    include <libpng/png.h>
-#  endif // HAVE_PNG_H
-#endif // HAVE_LIBPNG && HAVE_LIBZ
-}
+#include <FL/Fl_Image_Decoder.H>
 
 
 /**
@@ -62,94 +46,19 @@ extern "C"
 */
 Fl_PNG_Image::Fl_PNG_Image(const char *png) // I - File to read
   : Fl_RGB_Image(0,0,0) {
-#if defined(HAVE_LIBPNG) && defined(HAVE_LIBZ)
-  int		i;			// Looping var
-  FILE		*fp;			// File pointer
-  int		channels;		// Number of color channels
-  png_structp	pp;			// PNG read pointer
-  png_infop	info;			// PNG info pointers
-  png_bytep	*rows;			// PNG row pointers
-
-
-  // Open the PNG file...
-  if ((fp = fl_fopen(png, "rb")) == NULL) return;
-
-  // Setup the PNG data structures...
-  pp   = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  info = png_create_info_struct(pp);
-
-  if (setjmp(pp->jmpbuf))
-  {
-    Fl::warning("PNG file \"%s\" contains errors!\n", png);
-    return;
-  }
-
-  // Initialize the PNG read "engine"...
-  png_init_io(pp, fp);
-
-  // Get the image dimensions and convert to grayscale or RGB...
-  png_read_info(pp, info);
-
-  if (info->color_type == PNG_COLOR_TYPE_PALETTE)
-    png_set_expand(pp);
-
-  if (info->color_type & PNG_COLOR_MASK_COLOR)
-    channels = 3;
-  else
-    channels = 1;
-
-  if ((info->color_type & PNG_COLOR_MASK_ALPHA) || info->num_trans)
-    channels ++;
-
-  w((int)(info->width));
-  h((int)(info->height));
-  d(channels);
-
-  if (info->bit_depth < 8)
-  {
-    png_set_packing(pp);
-    png_set_expand(pp);
-  }
-  else if (info->bit_depth == 16)
-    png_set_strip_16(pp);
-
-#  if defined(HAVE_PNG_GET_VALID) && defined(HAVE_PNG_SET_TRNS_TO_ALPHA)
-  // Handle transparency...
-  if (png_get_valid(pp, info, PNG_INFO_tRNS))
-    png_set_tRNS_to_alpha(pp);
-#  endif // HAVE_PNG_GET_VALID && HAVE_PNG_SET_TRNS_TO_ALPHA
-
-  array = new uchar[w() * h() * d()];
-  alloc_array = 1;
-
-  // Allocate pointers...
-  rows = new png_bytep[h()];
-
-  for (i = 0; i < h(); i ++)
-    rows[i] = (png_bytep)(array + i * w() * d());
-
-  // Read the image, handling interlacing as needed...
-  for (i = png_set_interlace_handling(pp); i > 0; i --)
-    png_read_rows(pp, rows, NULL, h());
-
-#ifdef WIN32
-  // Some Windows graphics drivers don't honor transparency when RGB == white
-  if (channels == 4) {
-    // Convert RGB to 0 when alpha == 0...
-    uchar *ptr = (uchar *)array;
-    for (i = w() * h(); i > 0; i --, ptr += 4)
-      if (!ptr[3]) ptr[0] = ptr[1] = ptr[2] = 0;
-  }
-#endif // WIN32
-
-  // Free memory and return...
-  delete[] rows;
-
-  png_read_end(pp, info);
-  png_destroy_read_struct(&pp, &info, NULL);
+  Fl_Image_Decoder decoder;
+  decoder.png(this, png);
+}
 
-  fclose(fp);
-#endif // HAVE_LIBPNG && HAVE_LIBZ
+/**
+  The constructor loads a PNG image from the \p datasize bytes at
+  \p buffer.  \p name is only there for compatibility with other
+  versions of FLTK.  Use Fl_Image_Decoder to load images progressively.
+*/
+Fl_PNG_Image::Fl_PNG_Image(const char *name, const unsigned char *buffer, int datasize)
+  : Fl_RGB_Image(0,0,0) {
+  Fl_Image_Decoder decoder;
+  decoder.png(this, buffer, datasize);
 }
 
 
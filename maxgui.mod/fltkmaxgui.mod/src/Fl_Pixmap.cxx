@@ -51,6 +51,7 @@
 
 #include <stdio.h>
 #include "flstring.h"
+#include "Fl_Compiled_Pixmap.H"
 #include <ctype.h>
 
 #ifdef WIN32
@@ -115,6 +116,8 @@ void Fl_Quartz_Graphics_Driver::draw(Fl_Pixmap *pxm, int XP, int YP, int WP, int
     return;
     }
   if (!pxm->id_) {
+    // fl_draw_pixmap() uses the parsed data of any pixmap of the same data
+    if (!pxm->compiled_) pxm->compiled_ = fl_compile_pixmap(pxm->data());
     pxm->id_ = fl_create_offscreen_with_alpha(pxm->w(), pxm->h());
     fl_begin_offscreen((Fl_Offscreen)pxm->id_);
     fl_draw_pixmap(pxm->data(), 0, 0, FL_GREEN);
@@ -133,6 +136,8 @@ void Fl_GDI_Graphics_Driver::draw(Fl_Pixmap *pxm, int XP, int YP, int WP, int HP
     return;
   }
   if (!pxm->id_) {
+    // fl_draw_pixmap() uses the parsed data of any pixmap of the same data
+    if (!pxm->compiled_) pxm->compiled_ = fl_compile_pixmap(pxm->data());
     pxm->id_ = fl_create_offscreen(pxm->w(), pxm->h());
     fl_begin_offscreen((Fl_Offscreen)pxm->id_);
     uchar *bitmap = 0;
@@ -198,33 +203,45 @@ void Fl_Xlib_Graphics_Driver::draw(Fl_Pixmap *pxm, int XP, int YP, int WP, int H
     if (code == 2) pxm->draw_empty(XP, YP);
     return;
   }
-  if (!pxm->id_) {
-    pxm->id_ = fl_create_offscreen(pxm->w(), pxm->h());
-    fl_begin_offscreen((Fl_Offscreen)pxm->id_);
+  // the parsed data and its server copies are shared by all the pixmaps
+  // made from the same data, so each icon is only uploaded once
+  if (!pxm->compiled_) pxm->compiled_ = fl_compile_pixmap(pxm->data());
+  Fl_Compiled_Pixmap *p = pxm->compiled_;
+  if (!p) {
+    pxm->draw_empty(XP, YP);
+    return;
+  }
+  if (p->transparent && fl_can_do_alpha_blending()) {
+    // composite with XRender, which needs no clip mask to be set up
+    if (!p->image) p->image = new Fl_RGB_Image(p->rgba, p->w, p->h, 4);
+    p->image->draw(X, Y, W, H, cx, cy);
+    return;
+  }
+  if (!p->id) {
+    p->id = fl_create_offscreen(p->w, p->h);
+    fl_begin_offscreen(p->id);
     uchar *bitmap = 0;
     fl_mask_bitmap = &bitmap;
     fl_draw_pixmap(pxm->data(), 0, 0, FL_BLACK);
     fl_mask_bitmap = 0;
     if (bitmap) {
-      pxm->mask_ = fl_create_bitmask(pxm->w(), pxm->h(), bitmap);
+      p->mask = fl_create_bitmask(p->w, p->h, bitmap);
       delete[] bitmap;
     }
     fl_end_offscreen();
   }
-  if (pxm->mask_) {
+  if (p->mask) {
     // I can't figure out how to combine a mask with existing region,
     // so cut the image down to a clipped rectangle:
     int nx, ny; fl_clip_box(X,Y,W,H,nx,ny,W,H);
     cx += nx-X; X = nx;
     cy += ny-Y; Y = ny;
     // make X use the bitmap as a mask:
-    XSetClipMask(fl_display, fl_gc, pxm->mask_);
-    int ox = X-cx; if (ox < 0) ox += pxm->w();
-    int oy = Y-cy; if (oy < 0) oy += pxm->h();
+    XSetClipMask(fl_display, fl_gc, p->mask);
     XSetClipOrigin(fl_display, fl_gc, X-cx, Y-cy);
   }
-  fl_copy_offscreen(X, Y, W, H, pxm->id_, cx, cy);
-  if (pxm->mask_) {
+  fl_copy_offscreen(X, Y, W, H, p->id, cx, cy);
+  if (p->mask) {
     // put the old clip region back
     XSetClipOrigin(fl_display, fl_gc, 0, 0);
     fl_restore_clip();
@@ -252,6 +269,11 @@ void Fl_Pixmap::uncache() {
     fl_delete_bitmask((Fl_Bitmask)mask_);
     mask_ = 0;
   }
+
+  if (compiled_) {
+    fl_release_compiled_pixmap(compiled_);
+    compiled_ = 0;
+  }
 }
 
 void Fl_Pixmap::label(Fl_Widget* widget) {
@@ -48,17 +48,31 @@ Fl_Shared_Handler *Fl_Shared_Image::handlers_ = 0;// Additional format handlers
 int	Fl_Shared_Image::num_handlers_ = 0;	// Number of format handlers
 int	Fl_Shared_Image::alloc_handlers_ = 0;	// Allocated format handlers
 
-
-//
-// Typedef the C API sort function type the only way I know how...
-//
-
-extern "C" {
-  typedef int (*compare_func_t)(const void *, const void *);
+Fl_Shared_Image **Fl_Shared_Image::hash_ = 0;	// Hash chains by name
+int	Fl_Shared_Image::hash_size_ = 0;	// Number of hash chains
+Fl_Shared_Image *Fl_Shared_Image::unused_ = 0;	// Most recently released
+Fl_Shared_Image *Fl_Shared_Image::oldest_ = 0;	// Least recently released
+long	Fl_Shared_Image::budget_ = 0;		// Bytes of images kept
+long	Fl_Shared_Image::bytes_ = 0;		// Bytes of all images
+long	Fl_Shared_Image::hits_ = 0;		// get() found the image
+long	Fl_Shared_Image::misses_ = 0;		// get() loaded the image
+
+
+
+// FNV-1a hash of an image name
+static unsigned hash_name(const char *n) {
+  unsigned h = 2166136261u;
+  for (; *n; n ++) h = (h ^ (uchar)*n) * 16777619u;
+  return h;
 }
 
+// Estimated memory used by the data of an image
+static long image_size(Fl_Image *img) {
+  if (img->d() > 0) return (long)img->w() * img->h() * img->d();
+  else return (long)((img->w() + 7) / 8) * img->h();
+}
 
-/** Returns the Fl_Shared_Image* array */
+/** Returns the Fl_Shared_Image* array, in no particular order */
 Fl_Shared_Image **Fl_Shared_Image::images() {
   return images_;
 }
@@ -98,6 +112,11 @@ Fl_Shared_Image::Fl_Shared_Image() : Fl_Image(0,0,0) {
   original_    = 0;
   image_       = 0;
   alloc_image_ = 0;
+  index_       = -1;
+  size_        = 0;
+  next_        = 0;
+  newer_       = 0;
+  older_       = 0;
 }
 
 
@@ -118,6 +137,11 @@ Fl_Shared_Image::Fl_Shared_Image(const char *n,		// I - Filename
   image_       = img;
   alloc_image_ = !img;
   original_    = 1;
+  index_       = -1;
+  size_        = 0;
+  next_        = 0;
+  newer_       = 0;
+  older_       = 0;
 
   if (!img) reload();
   else update();
@@ -131,10 +155,12 @@ Fl_Shared_Image::Fl_Shared_Image(const char *n,		// I - Filename
 void
 Fl_Shared_Image::add() {
   Fl_Shared_Image	**temp;		// New image pointer array...
+  int			i;		// Looping var...
 
   if (num_images_ >= alloc_images_) {
     // Allocate more memory...
-    temp = new Fl_Shared_Image *[alloc_images_ + 32];
+    int n = alloc_images_ ? alloc_images_ * 2 : 32;
+    temp = new Fl_Shared_Image *[n];
 
     if (alloc_images_) {
       memcpy(temp, images_, alloc_images_ * sizeof(Fl_Shared_Image *));
@@ -143,22 +169,96 @@ Fl_Shared_Image::add() {
     }
 
     images_       = temp;
-    alloc_images_ += 32;
+    alloc_images_ = n;
   }
 
+  index_ = num_images_;
   images_[num_images_] = this;
   num_images_ ++;
 
-  if (num_images_ > 1) {
-    qsort(images_, num_images_, sizeof(Fl_Shared_Image *),
-          (compare_func_t)compare);
+  if (num_images_ > 2 * hash_size_) {
+    // Keep the chains short...
+    int n = hash_size_ ? hash_size_ * 4 : 64;
+    delete[] hash_;
+    hash_      = new Fl_Shared_Image *[n];
+    hash_size_ = n;
+    memset(hash_, 0, n * sizeof(Fl_Shared_Image *));
+
+    for (i = 0; i < num_images_ - 1; i ++) {
+      unsigned b = hash_name(images_[i]->name_) % hash_size_;
+      images_[i]->next_ = hash_[b];
+      hash_[b] = images_[i];
+    }
   }
+
+  unsigned b = hash_name(name_) % hash_size_;
+  next_    = hash_[b];
+  hash_[b] = this;
+
+  size_  = image_size(this);
+  bytes_ += size_;
+  trim();
 }
 
 
-//
-// 'Fl_Shared_Image::update()' - Update the dimensions of the shared images.
-//
+// Removes the image from the cache
+void
+Fl_Shared_Image::unhash() {
+  Fl_Shared_Image	**p;		// Link to this image
+
+  for (p = hash_ + hash_name(name_) % hash_size_; *p != this; p = &(*p)->next_) {}
+  *p = next_;
+
+  num_images_ --;
+  if (index_ < num_images_) {
+    images_[index_] = images_[num_images_];
+    images_[index_]->index_ = index_;
+  }
+  index_ = -1;
+  bytes_ -= size_;
+
+  if (num_images_ == 0 && images_) {
+    delete[] images_;
+    delete[] hash_;
+
+    images_       = 0;
+    alloc_images_ = 0;
+    hash_         = 0;
+    hash_size_    = 0;
+  }
+}
+
+
+// Takes a reference, fetching the image back from the unused list
+void
+Fl_Shared_Image::use() {
+  if (refcount_ == 0) {
+    if (newer_) newer_->older_ = older_;
+    else unused_ = older_;
+    if (older_) older_->newer_ = newer_;
+    else oldest_ = newer_;
+    newer_ = older_ = 0;
+  }
+
+  refcount_ ++;
+}
+
+
+// Deletes the least recently released images while over the budget
+void
+Fl_Shared_Image::trim() {
+  while (bytes_ > budget_ && oldest_) {
+    Fl_Shared_Image *img = oldest_;
+
+    oldest_ = img->newer_;
+    if (oldest_) oldest_->older_ = 0;
+    else unused_ = 0;
+
+    img->unhash();
+    delete img;
+  }
+}
+
 
 void
 Fl_Shared_Image::update() {
@@ -168,6 +268,12 @@ Fl_Shared_Image::update() {
     d(image_->d());
     data(image_->data(), image_->count());
   }
+
+  if (index_ >= 0) {
+    long size = image_size(this);
+    bytes_ += size - size_;
+    size_  = size;
+  }
 }
 
 /**
@@ -185,38 +291,54 @@ Fl_Shared_Image::~Fl_Shared_Image() {
 //
 /** 
   Releases and possibly destroys (if refcount <=0) a shared image. 
-  In the latter case, it will reorganize the shared image array so that no hole will occur.
+  When a memory_budget() is set, an image that is no longer referenced
+  is kept in the cache instead, until the budget is exceeded.
 */
 void Fl_Shared_Image::release() {
-  int	i;	// Looping var...
-
   refcount_ --;
   if (refcount_ > 0) return;
 
-  for (i = 0; i < num_images_; i ++)
-    if (images_[i] == this) {
-      num_images_ --;
+  if (index_ >= 0 && budget_ > 0) {
+    // Keep it for a later get(), most recently released first...
+    older_  = unused_;
+    newer_  = 0;
+    if (unused_) unused_->newer_ = this;
+    else oldest_ = this;
+    unused_ = this;
 
-      if (i < num_images_) {
-        memmove(images_ + i, images_ + i + 1,
-               (num_images_ - i) * sizeof(Fl_Shared_Image *));
-      }
+    trim();
+    return;
+  }
 
-      break;
-    }
+  if (index_ >= 0) unhash();
 
   delete this;
+}
 
-  if (num_images_ == 0 && images_) {
-    delete[] images_;
 
-    images_       = 0;
-    alloc_images_ = 0;
-  }
+/**
+  Sets how many bytes of image data the cache may hold before images that
+  are no longer referenced are deleted, least recently released first.
+  Images still in use are never deleted, so the cache can be larger than
+  the budget.  The default, 0, deletes an image as soon as it is released.
+  \see memory_used(), hits(), misses()
+*/
+void Fl_Shared_Image::memory_budget(long bytes) {
+  budget_ = bytes < 0 ? 0 : bytes;
+  trim();
+}
+
+
+/** Deletes all the cached images that are no longer referenced. */
+void Fl_Shared_Image::flush() {
+  long budget = budget_;
+
+  budget_ = 0;
+  trim();
+  budget_ = budget;
 }
 
 
-//
 /** Reloads the shared image from disk */
 void Fl_Shared_Image::reload() {
   // Load image from disk...
@@ -345,27 +467,22 @@ void Fl_Shared_Image::uncache()
 
 
 
-/** Finds a shared image from its named and size specifications */
+/**
+  Finds a shared image from its named and size specifications.
+  A size of 0 finds the image as it was loaded.
+*/
 Fl_Shared_Image* Fl_Shared_Image::find(const char *n, int W, int H) {
-  Fl_Shared_Image	*key,		// Image key
-			**match;	// Matching image
+  Fl_Shared_Image	*img;		// Current image
 
-  if (num_images_) {
-    key = new Fl_Shared_Image();
-    key->name_ = new char[strlen(n) + 1];
-    strcpy((char *)key->name_, n);
-    key->w(W);
-    key->h(H);
+  if (!hash_size_) return 0;
 
-    match = (Fl_Shared_Image **)bsearch(&key, images_, num_images_,
-                                        sizeof(Fl_Shared_Image *),
-                                        (compare_func_t)compare);
+  // Same rules as compare()...
+  for (img = hash_[hash_name(n) % hash_size_]; img; img = img->next_) {
+    if (strcmp(img->name_, n)) continue;
 
-    delete key;
-
-    if (match) {
-      (*match)->refcount_ ++;
-      return *match;
+    if ((W == 0 && img->original_) || (img->w() == W && img->h() == H)) {
+      img->use();
+      return img;
     }
   }
 
@@ -383,7 +500,12 @@ Fl_Shared_Image* Fl_Shared_Image::find(const char *n, int W, int H) {
 Fl_Shared_Image* Fl_Shared_Image::get(const char *n, int W, int H) {
   Fl_Shared_Image	*temp;		// Image
 
-  if ((temp = find(n, W, H)) != NULL) return temp;
+  if ((temp = find(n, W, H)) != NULL) {
+    hits_ ++;
+    return temp;
+  }
+
+  misses_ ++;
 
   if ((temp = find(n)) == NULL) {
     temp = new Fl_Shared_Image(n);
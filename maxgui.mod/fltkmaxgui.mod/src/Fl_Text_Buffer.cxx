@@ -32,6 +32,8 @@
 #include <ctype.h>
 #include <FL/Fl.H>
 #include <FL/Fl_Text_Buffer.H>
+#include "Fl_Text_Piece_Table.H"
+#include "Fl_Text_Line_Index.H"
 
 /*
  This file is based on a port of NEdit to FLTK many years ago. NEdit at that
@@ -189,6 +191,11 @@ Fl_Text_Buffer::Fl_Text_Buffer(int requestedSize, int preferredGapSize)
   mPredeleteCbArgs = NULL;
   mCursorPosHint = 0;
   mCanUndo = 1;
+  mPieces = NULL;
+  mLineIndex = new Fl_Text_Line_Index;
+  mBatchStart = -1;
+  mRingBytes = 0;
+  mRingLines = 0;
 #ifdef PURIFY
   {
     int i;
@@ -202,7 +209,11 @@ Fl_Text_Buffer::Fl_Text_Buffer(int requestedSize, int preferredGapSize)
 // unicode ok
 Fl_Text_Buffer::~Fl_Text_Buffer()
 {
+  if (mBatchStart >= 0)
+    Fl::remove_timeout(batch_timeout_cb, this);
   free(mBuf);
+  delete mPieces;
+  delete mLineIndex;
   if (mNModifyProcs != 0) {
     delete[]mModifyProcs;
     delete[]mCbArgs;
@@ -219,8 +230,7 @@ Fl_Text_Buffer::~Fl_Text_Buffer()
 // - unicode ok
 char *Fl_Text_Buffer::text() const {
   char *t = (char *) malloc(mLength + 1);
-  memcpy(t, mBuf, mGapStart);
-  memcpy(&t[mGapStart], &mBuf[mGapEnd], mLength - mGapStart);
+  copy_range_(t, 0, mLength);
   t[mLength] = '\0';
   return t;
 } 
@@ -229,27 +239,36 @@ char *Fl_Text_Buffer::text() const {
 // unicode ok, functions called have not been verified yet
 void Fl_Text_Buffer::text(const char *t)
 {
+  flush_batch();
   call_predelete_callbacks(0, length());
   
   /* Save information for redisplay, and get rid of the old buffer */
   const char *deletedText = text();
   int deletedLength = mLength;
-  free((void *) mBuf);
-  
-  /* Start a new buffer with a gap of mPreferredGapSize at the end */
   int insertedLength = strlen(t);
-  mBuf = (char *) malloc(insertedLength + mPreferredGapSize);
   mLength = insertedLength;
-  mGapStart = insertedLength;
-  mGapEnd = mGapStart + mPreferredGapSize;
-  memcpy(mBuf, t, insertedLength);
+  mLineIndex->clear();
+  mLineIndex->insert(0, t, insertedLength);
+  
+  if (mPieces) {
+    mPieces->clear();
+    mPieces->insert(0, t, insertedLength);
+  } else {
+    free((void *) mBuf);
+    
+    /* Start a new buffer with a gap of mPreferredGapSize at the end */
+    mBuf = (char *) malloc(insertedLength + mPreferredGapSize);
+    mGapStart = insertedLength;
+    mGapEnd = mGapStart + mPreferredGapSize;
+    memcpy(mBuf, t, insertedLength);
 #ifdef PURIFY
-  {
-    int i;
-    for (i = mGapStart; i < mGapEnd; i++)
-      mBuf[i] = '.';
-  }
+    {
+      int i;
+      for (i = mGapStart; i < mGapEnd; i++)
+        mBuf[i] = '.';
+    }
 #endif
+  }
   
   /* Zero all of the existing selections */
   update_selections(0, deletedLength, 0);
@@ -284,17 +303,82 @@ char *Fl_Text_Buffer::text_range(int start, int end) const {
   s = (char *) malloc(copiedLength + 1);
   
   /* Copy the text from the buffer to the returned string */
-  if (end <= mGapStart) {
-    memcpy(s, &mBuf[start], copiedLength);
+  copy_range_(s, start, end);
+  s[copiedLength] = '\0';
+  return s;
+}
+
+
+// Copies verbose from around the gap, or from the pieces.
+// - unicode ok
+void Fl_Text_Buffer::copy_range_(char *dst, int start, int end) const {
+  if (mPieces) {
+    mPieces->copy(dst, start, end);
+  } else if (end <= mGapStart) {
+    memcpy(dst, &mBuf[start], end - start);
   } else if (start >= mGapStart) {
-    memcpy(s, &mBuf[start + (mGapEnd - mGapStart)], copiedLength);
+    memcpy(dst, &mBuf[start + (mGapEnd - mGapStart)], end - start);
   } else {
     int part1Length = mGapStart - start;
-    memcpy(s, &mBuf[start], part1Length);
-    memcpy(&s[part1Length], &mBuf[mGapEnd], copiedLength - part1Length);
+    memcpy(dst, &mBuf[start], part1Length);
+    memcpy(&dst[part1Length], &mBuf[mGapEnd], end - start - part1Length);
+  }
+}
+
+
+const char *Fl_Text_Buffer::piece_address(int pos) const {
+  int len;
+  return mPieces->span(pos, &len);
+}
+
+
+// Returns the longest run of bytes starting at pos that can be read
+// without crossing the gap or a piece boundary.
+const char *Fl_Text_Buffer::span(int pos, int *len) const {
+  if (mPieces)
+    return mPieces->span(pos, len);
+  if (pos < mGapStart) {
+    *len = mGapStart - pos;
+    return mBuf + pos;
+  }
+  *len = mLength - pos;
+  return mBuf + pos + (mGapEnd - mGapStart);
+}
+
+
+// Same as span(), but for reading backwards from pos.
+const char *Fl_Text_Buffer::span_back(int pos, int *len) const {
+  if (mPieces)
+    return mPieces->span_back(pos, len);
+  if (pos < mGapStart) {
+    *len = pos + 1;
+    return mBuf + pos;
+  }
+  *len = pos - mGapStart + 1;
+  return mBuf + pos + (mGapEnd - mGapStart);
+}
+
+
+void Fl_Text_Buffer::storage(int engine)
+{
+  if (engine == storage())
+    return;
+  if (engine == PIECE_STORAGE) {
+    mPieces = new Fl_Text_Piece_Table;
+    mPieces->insert(0, mBuf, mGapStart);
+    mPieces->insert(mGapStart, mBuf + mGapEnd, mLength - mGapStart);
+    free((void *) mBuf);
+    mBuf = NULL;
+    mGapStart = mGapEnd = 0;
+  } else {
+    char *t = (char *) malloc(mLength + mPreferredGapSize);
+    mPieces->copy(t, 0, mLength);
+    delete mPieces;
+    mPieces = NULL;
+    mBuf = t;
+    mGapStart = mLength;
+    mGapEnd = mLength + mPreferredGapSize;
   }
-  s[copiedLength] = '\0';
-  return s;
 }
 
 
@@ -317,6 +401,8 @@ void Fl_Text_Buffer::insert(int pos, const char *text)
   if (pos < 0)
     pos = 0;
   
+  flush_batch();
+  
   /* Even if nothing is deleted, we must call these callbacks */
   call_predelete_callbacks(pos, 0);
   
@@ -324,6 +410,7 @@ void Fl_Text_Buffer::insert(int pos, const char *text)
   int nInserted = insert_(pos, text);
   mCursorPosHint = pos + nInserted;
   call_modify_callbacks(pos, 0, nInserted, 0, NULL);
+  trim_to_ring_limit_();
 }
 
 
@@ -338,6 +425,7 @@ void Fl_Text_Buffer::replace(int start, int end, const char *text)
   if (end > mLength)
     end = mLength;
   
+  flush_batch();
   call_predelete_callbacks(start, end - start);
   const char *deletedText = text_range(start, end);
   remove_(start, end);
@@ -369,6 +457,7 @@ void Fl_Text_Buffer::remove(int start, int end)
   if (start == end)
     return;
   
+  flush_batch();
   call_predelete_callbacks(start, end - start);
   /* Remove and redisplay */
   const char *deletedText = text_range(start, end);
@@ -383,6 +472,18 @@ void Fl_Text_Buffer::copy(Fl_Text_Buffer * fromBuf, int fromStart,
 {
   int copiedLength = fromEnd - fromStart;
   
+  flush_batch();
+  if (mPieces) {
+    char *t = (char *) malloc(copiedLength);
+    fromBuf->copy_range_(t, fromStart, fromEnd);
+    mPieces->insert(toPos, t, copiedLength);
+    mLineIndex->insert(toPos, t, copiedLength);
+    free(t);
+    mLength += copiedLength;
+    update_selections(toPos, 0, copiedLength);
+    return;
+  }
+  
   /* Prepare the buffer to receive the new text.  If the new text fits in
    the current buffer, just move the gap (if necessary) to where
    the text should be inserted.  If the new text is too large, reallocate
@@ -394,19 +495,8 @@ void Fl_Text_Buffer::copy(Fl_Text_Buffer * fromBuf, int fromStart,
     move_gap(toPos);
   
   /* Insert the new text (toPos now corresponds to the start of the gap) */
-  if (fromEnd <= fromBuf->mGapStart) {
-    memcpy(&mBuf[toPos], &fromBuf->mBuf[fromStart], copiedLength);
-  } else if (fromStart >= fromBuf->mGapStart) {
-    memcpy(&mBuf[toPos],
-	   &fromBuf->mBuf[fromStart +
-			  (fromBuf->mGapEnd - fromBuf->mGapStart)],
-	   copiedLength);
-  } else {
-    int part1Length = fromBuf->mGapStart - fromStart;
-    memcpy(&mBuf[toPos], &fromBuf->mBuf[fromStart], part1Length);
-    memcpy(&mBuf[toPos + part1Length],
-	   &fromBuf->mBuf[fromBuf->mGapEnd], copiedLength - part1Length);
-  }
+  fromBuf->copy_range_(&mBuf[toPos], fromStart, fromEnd);
+  mLineIndex->insert(toPos, &mBuf[toPos], copiedLength);
   mGapStart += copiedLength;
   mLength += copiedLength;
   update_selections(toPos, 0, copiedLength);
@@ -450,6 +540,102 @@ int Fl_Text_Buffer::undo(int *cursorPos)
 }
 
 
+void Fl_Text_Buffer::batch_timeout_cb(void *v)
+{
+  ((Fl_Text_Buffer *) v)->flush_batch();
+}
+
+
+/*
+ Batched appends go into the buffer right away, so everything that reads
+ the buffer sees them, but the modify callbacks are only told once per
+ frame, with a single insertion that covers all of them. Whatever changes
+ the buffer in another way first calls flush_batch(), so the callbacks
+ always see the modifications in the order they were made.
+ */
+void Fl_Text_Buffer::batch_append(const char *t)
+{
+  if (!t || !*t)
+    return;
+  if (mBatchStart < 0) {
+    mBatchStart = mLength;
+    Fl::add_timeout(1.0 / 60.0, batch_timeout_cb, this);
+  }
+  char canUndo = mCanUndo;
+  mCanUndo = 0;
+  mCursorPosHint = mLength + insert_(mLength, t);
+  mCanUndo = canUndo;
+}
+
+
+void Fl_Text_Buffer::flush_batch()
+{
+  if (mBatchStart < 0)
+    return;
+  Fl::remove_timeout(batch_timeout_cb, this);
+  int pos = mBatchStart;
+  mBatchStart = -1;
+  call_predelete_callbacks(pos, 0);
+  call_modify_callbacks(pos, 0, mLength - pos, 0, NULL);
+  trim_to_ring_limit_();
+}
+
+
+void Fl_Text_Buffer::ring_limit(int maxBytes, int maxLines)
+{
+  mRingBytes = maxBytes > 0 ? maxBytes : 0;
+  mRingLines = maxLines > 0 ? maxLines : 0;
+  if (mBatchStart < 0)
+    trim_to_ring_limit_();
+}
+
+
+// Removes whole lines from the start of the buffer until it fits the
+// ring limits. The last line is never removed. The trim is not recorded
+// for undo, and a pending undo record is moved along with the text, or
+// dropped if it reaches into the trimmed lines.
+void Fl_Text_Buffer::trim_to_ring_limit_()
+{
+  if (!mRingBytes && !mRingLines)
+    return;
+  int lines = mLineIndex->lines();
+  int cut = 0;
+  if (mRingLines) {
+    int n = lines;
+    if (mLength && character(mLength - 1) == '\n')
+      n--;                      // the empty line after the last newline
+    if (n > mRingLines)
+      cut = mLineIndex->line_start(n - mRingLines);
+  }
+  if (mRingBytes && mLength - cut > mRingBytes) {
+    int pos = mLength - mRingBytes;
+    int line = mLineIndex->line_of(pos);
+    if (mLineIndex->line_start(line) != pos)
+      line++;
+    if (line > lines - 1)
+      line = lines - 1;
+    cut = mLineIndex->line_start(line);
+  }
+  if (cut <= 0)
+    return;
+  call_predelete_callbacks(0, cut);
+  const char *deletedText = text_range(0, cut);
+  char canUndo = mCanUndo;
+  mCanUndo = 0;
+  remove_(0, cut);
+  mCanUndo = canUndo;
+  if (undowidget == this) {
+    if (undoat - undoinsert < cut)
+      undocut = undoinsert = undoyankcut = 0;
+    else
+      undoat -= cut;
+  }
+  mCursorPosHint = mCursorPosHint > cut ? mCursorPosHint - cut : 0;
+  call_modify_callbacks(0, cut, 0, 0, deletedText);
+  free((void *) deletedText);
+}
+
+
 // unicode ok
 void Fl_Text_Buffer::canUndo(char flag)
 {
@@ -460,6 +646,7 @@ void Fl_Text_Buffer::insert_column(int column, int startPos,
 				   const char *text, int *charsInserted,
 				   int *charsDeleted)
 {
+  flush_batch();
   int nLines = countLines(text);
   int lineStartPos = line_start(startPos);
   int nDeleted = line_end(skip_lines(startPos, nLines)) - lineStartPos;
@@ -486,6 +673,7 @@ void Fl_Text_Buffer::overlay_rectangular(int startPos, int rectStart,
 					 int *charsDeleted)
 {
   
+  flush_batch();
   int nLines = countLines(text);
   int lineStartPos = line_start(startPos);
   int nDeleted = line_end(skip_lines(startPos, nLines)) - lineStartPos;
@@ -512,6 +700,8 @@ void Fl_Text_Buffer::replace_rectangular(int start, int end, int rectStart,
   char *insText = (char *) "";
   int linesPadded = 0;
   
+  flush_batch();
+  
   /* Make sure start and end refer to complete lines, since the
    columnar delete and insert operations will replace whole lines */
   start = line_start(start);
@@ -567,6 +757,7 @@ void Fl_Text_Buffer::remove_rectangular(int start, int end, int rectStart,
 					int rectEnd)
 {
   
+  flush_batch();
   start = line_start(start);
   end = line_end(end);
   call_predelete_callbacks(start, end - start);
@@ -627,6 +818,8 @@ char *Fl_Text_Buffer::text_in_rectangle(int start, int end,
 
 void Fl_Text_Buffer::tab_distance(int tabDist)
 {
+  flush_batch();
+  
   /* First call the pre-delete callbacks with the previous tab setting 
    still active. */
   call_predelete_callbacks(0, mLength);
@@ -1090,21 +1283,26 @@ int Fl_Text_Buffer::skip_displayed_characters(int lineStartPos, int nChars)
 }
 
 int Fl_Text_Buffer::count_lines(int startPos, int endPos) const {
-  int gapLen = mGapEnd - mGapStart;
   int lineCount = 0;
   
+  if (endPos < startPos || endPos > mLength)
+    endPos = mLength;
+  
+  /* the line index answers long ranges in O(log n), short ones are
+   cheaper to scan */
+  if (endPos - startPos > 1024)
+    return mLineIndex->line_of(endPos) - mLineIndex->line_of(startPos);
+  
   int pos = startPos;
-  while (pos < mGapStart)
-  {
-    if (pos == endPos)
-      return lineCount;
-    if (mBuf[pos++] == '\n')
-      lineCount++;
-  } while (pos < mLength) {
-    if (pos == endPos)
-      return lineCount;
-    if (mBuf[pos++ + gapLen] == '\n')
-      lineCount++;
+  while (pos < endPos) {
+    int n;
+    const char *p = span(pos, &n);
+    if (n > endPos - pos)
+      n = endPos - pos;
+    for (const char *e = p + n; p < e; p++)
+      if (*p == '\n')
+        lineCount++;
+    pos += n;
   }
   return lineCount;
 }
@@ -1113,22 +1311,21 @@ int Fl_Text_Buffer::skip_lines(int startPos, int nLines)
 {
   if (nLines == 0)
     return startPos;
+  if (nLines > 0)
+    return mLineIndex->line_start(mLineIndex->line_of(startPos) + nLines);
   
-  int gapLen = mGapEnd - mGapStart;
   int pos = startPos;
   int lineCount = 0;
-  while (pos < mGapStart) {
-    if (mBuf[pos++] == '\n') {
-      lineCount++;
-      if (lineCount == nLines)
-	return pos;
-    }
-  }
   while (pos < mLength) {
-    if (mBuf[pos++ + gapLen] == '\n') {
-      lineCount++;
-      if (lineCount >= nLines)
-	return pos;
+    int n;
+    const char *p = span(pos, &n);
+    for (const char *e = p + n; p < e; p++) {
+      pos++;
+      if (*p == '\n') {
+        lineCount++;
+        if (lineCount >= nLines)
+          return pos;
+      }
     }
   }
   return pos;
@@ -1140,23 +1337,8 @@ int Fl_Text_Buffer::rewind_lines(int startPos, int nLines)
   if (pos <= 0)
     return 0;
   
-  int gapLen = mGapEnd - mGapStart;
-  int lineCount = -1;
-  while (pos >= mGapStart) {
-    if (mBuf[pos + gapLen] == '\n') {
-      if (++lineCount >= nLines)
-	return pos + 1;
-    }
-    pos--;
-  }
-  while (pos >= 0) {
-    if (mBuf[pos] == '\n') {
-      if (++lineCount >= nLines)
-	return pos + 1;
-    }
-    pos--;
-  }
-  return 0;
+  int line = mLineIndex->line_of(startPos) - nLines;
+  return line > 0 ? mLineIndex->line_start(line) : 0;
 }
 
 int Fl_Text_Buffer::search_forward(int startPos, const char *searchString,
@@ -1212,27 +1394,20 @@ int Fl_Text_Buffer::search_backward(int startPos, const char *searchString,
 int Fl_Text_Buffer::findchars_forward(int startPos,
 				      const char *searchChars,
 				      int *foundPos) const {
-  int gapLen = mGapEnd - mGapStart;
   const char *c;
   
   int pos = startPos;
-  while (pos < mGapStart)
-  {
-    for (c = searchChars; *c != '\0'; c++) {
-      if (mBuf[pos] == *c) {
-        *foundPos = pos;
-        return 1;
-      }
-    } pos++;
-  }
   while (pos < mLength) {
-    for (c = searchChars; *c != '\0'; c++) {
-      if (mBuf[pos + gapLen] == *c) {
-	*foundPos = pos;
-	return 1;
+    int n;
+    const char *p = span(pos, &n);
+    for (; n > 0; n--, p++, pos++) {
+      for (c = searchChars; *c != '\0'; c++) {
+        if (*p == *c) {
+          *foundPos = pos;
+          return 1;
+        }
       }
     }
-    pos++;
   }
   *foundPos = mLength;
   return 0;
@@ -1241,7 +1416,6 @@ int Fl_Text_Buffer::findchars_forward(int startPos,
 int Fl_Text_Buffer::findchars_backward(int startPos,
 				       const char *searchChars,
 				       int *foundPos) const {
-  int gapLen = mGapEnd - mGapStart;
   const char *c;
   
   if (startPos == 0)
@@ -1250,23 +1424,17 @@ int Fl_Text_Buffer::findchars_backward(int startPos,
     return 0;
   }
   int pos = startPos == 0 ? 0 : startPos - 1;
-  while (pos >= mGapStart) {
-    for (c = searchChars; *c != '\0'; c++) {
-      if (mBuf[pos + gapLen] == *c) {
-	*foundPos = pos;
-	return 1;
-      }
-    }
-    pos--;
-  }
   while (pos >= 0) {
-    for (c = searchChars; *c != '\0'; c++) {
-      if (mBuf[pos] == *c) {
-	*foundPos = pos;
-	return 1;
+    int n;
+    const char *p = span_back(pos, &n);
+    for (; n > 0; n--, p--, pos--) {
+      for (c = searchChars; *c != '\0'; c++) {
+        if (*p == *c) {
+          *foundPos = pos;
+          return 1;
+        }
       }
     }
-    pos--;
   }
   *foundPos = 0;
   return 0;
@@ -1276,19 +1444,24 @@ int Fl_Text_Buffer::insert_(int pos, const char *text)
 {
   int insertedLength = strlen(text);
   
-  /* Prepare the buffer to receive the new text.  If the new text fits in
-   the current buffer, just move the gap (if necessary) to where
-   the text should be inserted.  If the new text is too large, reallocate
-   the buffer with a gap large enough to accomodate the new text and a
-   gap of mPreferredGapSize */
-  if (insertedLength > mGapEnd - mGapStart)
-    reallocate_with_gap(pos, insertedLength + mPreferredGapSize);
-  else if (pos != mGapStart)
-    move_gap(pos);
-  
-  /* Insert the new text (pos now corresponds to the start of the gap) */
-  memcpy(&mBuf[pos], text, insertedLength);
-  mGapStart += insertedLength;
+  if (mPieces) {
+    mPieces->insert(pos, text, insertedLength);
+  } else {
+    /* Prepare the buffer to receive the new text.  If the new text fits in
+     the current buffer, just move the gap (if necessary) to where
+     the text should be inserted.  If the new text is too large, reallocate
+     the buffer with a gap large enough to accomodate the new text and a
+     gap of mPreferredGapSize */
+    if (insertedLength > mGapEnd - mGapStart)
+      reallocate_with_gap(pos, insertedLength + mPreferredGapSize);
+    else if (pos != mGapStart)
+      move_gap(pos);
+    
+    /* Insert the new text (pos now corresponds to the start of the gap) */
+    memcpy(&mBuf[pos], text, insertedLength);
+    mGapStart += insertedLength;
+  }
+  mLineIndex->insert(pos, text, insertedLength);
   mLength += insertedLength;
   update_selections(pos, 0, insertedLength);
   
@@ -1326,27 +1499,23 @@ void Fl_Text_Buffer::remove_(int start, int end)
     undowidget = this;
   }
   
-  if (start > mGapStart) {
-    if (mCanUndo)
-      memcpy(undobuffer, mBuf + (mGapEnd - mGapStart) + start,
-	     end - start);
-    move_gap(start);
-  } else if (end < mGapStart) {
-    if (mCanUndo)
-      memcpy(undobuffer, mBuf + start, end - start);
-    move_gap(end);
+  if (mCanUndo)
+    copy_range_(undobuffer, start, end);
+  
+  mLineIndex->remove(start, end);
+  if (mPieces) {
+    mPieces->remove(start, end);
   } else {
-    int prelen = mGapStart - start;
-    if (mCanUndo) {
-      memcpy(undobuffer, mBuf + start, prelen);
-      memcpy(undobuffer + prelen, mBuf + mGapEnd, end - start - prelen);
-    }
+    if (start > mGapStart)
+      move_gap(start);
+    else if (end < mGapStart)
+      move_gap(end);
+    
+    /* expand the gap to encompass the deleted characters */
+    mGapEnd += end - mGapStart;
+    mGapStart -= mGapStart - start;
   }
   
-  /* expand the gap to encompass the deleted characters */
-  mGapEnd += end - mGapStart;
-  mGapStart -= mGapStart - start;
-  
   /* update the length */
   mLength -= end - start;
   
@@ -2089,19 +2258,15 @@ int Fl_Text_Buffer::findchar_forward(int startPos, char searchChar,
   }
   
   int pos = startPos;
-  while (pos < mGapStart) {
-    if (mBuf[pos] == searchChar) {
-      *foundPos = pos;
-      return 1;
-    }
-    pos++;
-  }
-  
-  for (int gapLen = mGapEnd - mGapStart; pos < mLength; pos++) {
-    if (mBuf[pos + gapLen] == searchChar) {
-      *foundPos = pos;
+  while (pos < mLength) {
+    int n;
+    const char *p = span(pos, &n);
+    const char *q = (const char *) memchr(p, searchChar, n);
+    if (q) {
+      *foundPos = pos + (q - p);
       return 1;
     }
+    pos += n;
   }
   *foundPos = mLength;
   return 0;
@@ -2117,17 +2282,14 @@ int Fl_Text_Buffer::findchar_backward(int startPos, char searchChar,
   }
   
   int pos = startPos - 1;
-  for (int gapLen = mGapEnd - mGapStart; pos >= mGapStart; pos--) {
-    if (mBuf[pos + gapLen] == searchChar) {
-      *foundPos = pos;
-      return 1;
-    }
-  }
-  
-  for (; pos >= 0; pos--) {
-    if (mBuf[pos] == searchChar) {
-      *foundPos = pos;
-      return 1;
+  while (pos >= 0) {
+    int n;
+    const char *p = span_back(pos, &n);
+    for (; n > 0; n--, p--, pos--) {
+      if (*p == searchChar) {
+        *foundPos = pos;
+        return 1;
+      }
     }
   }
   *foundPos = 0;
@@ -48,15 +48,22 @@
 
 #define NO_HINT -1
 
+/* In continuous wrap mode, the wrapped lines of the whole buffer are
+   counted in idle callbacks, WRAP_COUNT_SLICE bytes at a time.  The count
+   is checkpointed every WRAP_MARK_LINES buffer lines, so an edit only
+   restarts it from the checkpoint before the edit. */
+#define WRAP_MARK_LINES 256
+#define WRAP_COUNT_SLICE 32768
+
 /* Masks for text drawing methods.  These are or'd together to form an
    integer which describes what drawing calls to use to draw a string */
-#define FILL_MASK         0x0100
-#define SECONDARY_MASK    0x0200
-#define PRIMARY_MASK      0x0400
-#define HIGHLIGHT_MASK    0x0800
-#define BG_ONLY_MASK      0x1000
-#define TEXT_ONLY_MASK    0x2000
-#define STYLE_LOOKUP_MASK   0xff
+#define FILL_MASK         0x01000000
+#define SECONDARY_MASK    0x02000000
+#define PRIMARY_MASK      0x04000000
+#define HIGHLIGHT_MASK    0x08000000
+#define BG_ONLY_MASK      0x10000000
+#define TEXT_ONLY_MASK    0x20000000
+#define STYLE_LOOKUP_MASK   0x00ffffff
 
 /* Maximum displayable line length (how many characters will fit across the
    widest window).  This amount of memory is temporarily allocated from the
@@ -131,6 +138,7 @@ Fl_Text_Display::Fl_Text_Display(int X, int Y, int W, int H,  const char* l)
 
   mFixedFontWidth = -1;
   mStyleBuffer = 0;
+  mStyleRuns = 0;
   mStyleTable = 0;
   mNStyles = 0;
   mNVisibleLines = 1;
@@ -150,6 +158,8 @@ Fl_Text_Display::Fl_Text_Display(int X, int Y, int W, int H,  const char* l)
   mContinuousWrap = 0;
   mWrapMargin = 0;
   mSuppressResync = mNLinesDeleted = mModifyingTabDistance = 0;
+  mWrapMarks = 0;
+  mNWrapMarks = mWrapMarksSize = 0;
 }
 
 /**   Free a text display and release its associated memory.  Note, the text
@@ -165,7 +175,9 @@ Fl_Text_Display::~Fl_Text_Display() {
     mBuffer->remove_modify_callback(buffer_modified_cb, this);
     mBuffer->remove_predelete_callback(buffer_predelete_cb, this);
   }
+  if (mNWrapMarks) Fl::remove_idle(wrap_count_idle_cb, this);
   if (mLineStarts) delete[] mLineStarts;
+  free(mWrapMarks);
 }
 
 /**  
@@ -216,6 +228,7 @@ void Fl_Text_Display::highlight_data(Fl_Text_Buffer *styleBuffer,
                                 Unfinished_Style_Cb unfinishedHighlightCB,
                                 void *cbArg ) {
   mStyleBuffer = styleBuffer;
+  mStyleRuns = 0;
   mStyleTable = styleTable;
   mNStyles = nStyles;
   mUnfinishedStyle = unfinishedStyle;
@@ -226,6 +239,55 @@ void Fl_Text_Display::highlight_data(Fl_Text_Buffer *styleBuffer,
   damage(FL_DAMAGE_EXPOSE);
 }
 
+/**
+   Attach highlight information kept as style runs instead of a style
+   buffer.  The style of a run is looked up in the style table as
+   style - 'A', just like a style buffer character, but it is not limited
+   to 8 bits, so the table may have any number of entries.  Style changes
+   are not signalled through a selection as with a style buffer; the
+   caller has to call redisplay_range() for text it restyles.
+
+   The runs, the table and their associated memory are managed by the caller.
+*/
+void Fl_Text_Display::highlight_data(Fl_Text_Style_Runs *styleRuns,
+                                const Style_Table_Entry *styleTable,
+                                int nStyles, char unfinishedStyle,
+                                Unfinished_Style_Cb unfinishedHighlightCB,
+                                void *cbArg ) {
+  mStyleBuffer = 0;
+  mStyleRuns = styleRuns;
+  mStyleTable = styleTable;
+  mNStyles = nStyles;
+  mUnfinishedStyle = unfinishedStyle;
+  mUnfinishedHighlightCB = unfinishedHighlightCB;
+  mHighlightCBArg = cbArg;
+
+  damage(FL_DAMAGE_EXPOSE);
+}
+
+/**
+   Returns the style of the character at pos from the style buffer or the
+   style runs, parsing it first if it is still "unfinished".
+*/
+int Fl_Text_Display::style_at(int pos) const {
+  int style;
+  if (mStyleRuns)
+    style = mStyleRuns->style(pos);
+  else
+    // FIXME: character is ucs-4
+    style = (unsigned char) mStyleBuffer->character(pos);
+  if (style == mUnfinishedStyle && mUnfinishedHighlightCB) {
+    /* encountered "unfinished" style, trigger parsing */
+    (mUnfinishedHighlightCB)(pos, mHighlightCBArg);
+    if (mStyleRuns)
+      style = mStyleRuns->style(pos);
+    else
+      // FIXME: character is ucs-4
+      style = (unsigned char) mStyleBuffer->character(pos);
+  }
+  return style & STYLE_LOOKUP_MASK;
+}
+
 int Fl_Text_Display::longest_vline() const {
   int longest = 0;
   for (int i = 0; i < mNVisibleLines; i++)
@@ -277,9 +339,7 @@ void Fl_Text_Display::resize(int X, int Y, int W, int H) {
        the top character no longer pointing at a valid line start */
     if (mContinuousWrap && !mWrapMargin && W!=oldWidth) {
       int oldFirstChar = mFirstChar;
-      mNBufferLines = count_lines(0, buffer()->length(), true);
-      mFirstChar = line_start(mFirstChar);
-      mTopLineNum = count_lines(0, mFirstChar, true)+1;
+      start_wrap_count();
       absolute_top_line_number(oldFirstChar);
 
 #ifdef DEBUG
@@ -578,14 +638,21 @@ void Fl_Text_Display::wrap_mode(int wrap, int wrapMargin) {
   mContinuousWrap = wrap;
 
   if (buffer()) {
-    /* wrapping can change the total number of lines, re-count */
-    mNBufferLines = count_lines(0, buffer()->length(), true);
-
-    /* changing wrap margins or changing from wrapped mode to non-wrapped
-       can leave the character at the top no longer at a line start, and/or
-       change the line number */
-    mFirstChar = line_start(mFirstChar);
-    mTopLineNum = count_lines(0, mFirstChar, true) + 1;
+    /* wrapping can change the total number of lines, re-count.  Changing
+       wrap margins or changing from wrapped mode to non-wrapped can leave
+       the character at the top no longer at a line start, and/or change
+       the line number */
+    if (mContinuousWrap) {
+      start_wrap_count();
+    } else {
+      if (mNWrapMarks) {
+        Fl::remove_idle(wrap_count_idle_cb, this);
+        mNWrapMarks = 0;
+      }
+      mNBufferLines = count_lines(0, buffer()->length(), true);
+      mFirstChar = line_start(mFirstChar);
+      mTopLineNum = count_lines(0, mFirstChar, true) + 1;
+    }
 
     reset_absolute_top_line_number();
 
@@ -1247,6 +1314,14 @@ void Fl_Text_Display::buffer_modified_cb( int pos, int nInserted, int nDeleted,
   /* Update the line count for the whole buffer */
   textD->mNBufferLines += linesInserted - linesDeleted;
 
+  /* If the wrapped lines are still being counted, recount from the last
+     checkpoint before the modification */
+  if (textD->mNWrapMarks) {
+    int mark = buf->count_lines(0, pos) / WRAP_MARK_LINES + 1;
+    if (textD->mNWrapMarks > mark)
+      textD->mNWrapMarks = mark;
+  }
+
   /* Update the cursor position */
   if ( textD->mCursorToHint != NO_HINT ) {
     textD->mCursorPos = textD->mCursorToHint;
@@ -1352,6 +1427,96 @@ void Fl_Text_Display::absolute_top_line_number(int oldFirstChar) {
     }
 }
 
+/**
+   Starts counting the wrapped lines of the whole buffer in the background.
+   Counting a large document at once would block the application, so
+   mNBufferLines and mTopLineNum are estimated here from the wrapping of the
+   text on screen, and corrected by finish_wrap_count() once the idle
+   callback has gone through the whole buffer.  The displayed lines
+   themselves are always exact, as they are measured from mFirstChar.
+*/
+void Fl_Text_Display::start_wrap_count() {
+  Fl_Text_Buffer *buf = buffer();
+  mFirstChar = line_start(mFirstChar);
+
+  /* extrapolate the wrapped lines per byte of the visible lines */
+  int sampleStart = buf->line_start(mFirstChar);
+  int sampleEnd = buf->skip_lines(mFirstChar, mNVisibleLines);
+  double extra = 0.0;
+  if (sampleEnd > sampleStart)
+    extra = (double)(count_lines(sampleStart, sampleEnd, true) -
+                     buf->count_lines(sampleStart, sampleEnd)) /
+            (sampleEnd - sampleStart);
+  mNBufferLines = buf->count_lines(0, buf->length()) +
+                  (int)(extra * buf->length());
+  mTopLineNum = buf->count_lines(0, sampleStart) + (int)(extra * sampleStart) +
+                count_lines(sampleStart, mFirstChar, true) + 1;
+  if (mTopLineNum > mNBufferLines + 1)
+    mNBufferLines = mTopLineNum - 1;
+
+  if (!mWrapMarksSize) {
+    mWrapMarksSize = 64;
+    mWrapMarks = (int *)malloc(mWrapMarksSize * sizeof(int));
+  }
+  mWrapMarks[0] = 0;
+  mNWrapMarks = 1;
+  if (!Fl::has_idle(wrap_count_idle_cb, this))
+    Fl::add_idle(wrap_count_idle_cb, this);
+}
+
+void Fl_Text_Display::wrap_count_idle_cb(void *v) {
+  Fl_Text_Display *textD = (Fl_Text_Display *)v;
+  if (textD->wrap_count_step(WRAP_COUNT_SLICE))
+    Fl::remove_idle(wrap_count_idle_cb, v);
+}
+
+/**
+   Counts the wrapped lines of roughly "budget" more bytes of the buffer,
+   one block of WRAP_MARK_LINES buffer lines at a time.  Returns 1 when
+   there is nothing left to count.
+*/
+int Fl_Text_Display::wrap_count_step(int budget) {
+  Fl_Text_Buffer *buf = buffer();
+  if (!buf || !mContinuousWrap || !mNWrapMarks) {
+    mNWrapMarks = 0;
+    return 1;
+  }
+  int length = buf->length();
+  int nLines = buf->count_lines(0, length);
+  int mark = mNWrapMarks - 1;
+  int pos = buf->skip_lines(0, mark * WRAP_MARK_LINES);
+  while (budget > 0) {
+    if ((mark + 1) * WRAP_MARK_LINES > nLines) {
+      finish_wrap_count(mWrapMarks[mark] + count_lines(pos, length, true));
+      return 1;
+    }
+    int next = buf->skip_lines(pos, WRAP_MARK_LINES);
+    if (mark + 1 >= mWrapMarksSize) {
+      mWrapMarksSize *= 2;
+      mWrapMarks = (int *)realloc(mWrapMarks, mWrapMarksSize * sizeof(int));
+    }
+    mWrapMarks[mark + 1] = mWrapMarks[mark] + count_lines(pos, next, true);
+    mNWrapMarks = ++mark + 1;
+    budget -= next - pos;
+    pos = next;
+  }
+  return 0;
+}
+
+/**
+   Replaces the estimated line counts by the result of the background count,
+   and updates the scrollbars.
+*/
+void Fl_Text_Display::finish_wrap_count(int nLines) {
+  Fl_Text_Buffer *buf = buffer();
+  int mark = buf->count_lines(0, mFirstChar) / WRAP_MARK_LINES;
+  int markPos = buf->skip_lines(0, mark * WRAP_MARK_LINES);
+  mTopLineNum = mWrapMarks[mark] + count_lines(markPos, mFirstChar, true) + 1;
+  mNBufferLines = nLines;
+  mNWrapMarks = 0;
+  resize(x(), y(), w(), h());
+}
+
 /**
    Return true if a separate absolute top line number is being maintained
    (for displaying line numbers or showing in the statistics line).
@@ -1822,7 +1987,6 @@ void Fl_Text_Display::draw_cursor( int X, int Y ) {
 int Fl_Text_Display::position_style( int lineStartPos,
                                      int lineLen, int lineIndex, int dispIndex ) const {
   Fl_Text_Buffer * buf = mBuffer;
-  Fl_Text_Buffer *styleBuf = mStyleBuffer;
   int pos, style = 0;
 
   if ( lineStartPos == -1 || buf == NULL )
@@ -1832,16 +1996,8 @@ int Fl_Text_Display::position_style( int lineStartPos,
 
   if ( lineIndex >= lineLen )
     style = FILL_MASK;
-  else if ( styleBuf != NULL ) {
-    // FIXME: character is ucs-4
-    style = ( unsigned char ) styleBuf->character( pos );
-    if (style == mUnfinishedStyle && mUnfinishedHighlightCB) {
-        /* encountered "unfinished" style, trigger parsing */
-        (mUnfinishedHighlightCB)( pos, mHighlightCBArg);
-        // FIXME: character is ucs-4
-        style = (unsigned char) styleBuf->character( pos);
-    }
-  }
+  else if ( mStyleBuffer != NULL || mStyleRuns != NULL )
+    style = style_at( pos );
   if (buf->primary_selection()->includes(pos, lineStartPos, dispIndex))
     style |= PRIMARY_MASK;
   if (buf->highlight_selection()->includes(pos, lineStartPos, dispIndex))
@@ -2344,7 +2500,7 @@ int Fl_Text_Display::measure_vline( int visLineNum ) const {
   char expandedChar[ FL_TEXT_MAX_EXP_CHAR_LEN ];
 
   if (lineStartPos < 0 || lineLen == 0) return 0;
-  if ( mStyleBuffer == NULL ) {
+  if ( mStyleBuffer == NULL && mStyleRuns == NULL ) {
     for ( i = 0; i < lineLen; i++ ) {
       len = mBuffer->expand_character( lineStartPos + i,
                                        charCount, expandedChar );
@@ -2359,9 +2515,7 @@ int Fl_Text_Display::measure_vline( int visLineNum ) const {
     for ( i = 0; i < lineLen; i++ ) {
       len = mBuffer->expand_character( lineStartPos + i,
                                        charCount, expandedChar );
-      // FIXME: character is ucs-4
-      style = ( unsigned char ) mStyleBuffer->character(
-                lineStartPos + i ) - 'A';
+      style = style_at( lineStartPos + i ) - 'A';
 
       if (style < 0) style = 0;
       else if (style >= mNStyles) style = mNStyles - 1;
@@ -2802,20 +2956,12 @@ void Fl_Text_Display::wrapped_line_counter(Fl_Text_Buffer *buf, int startPos,
 int Fl_Text_Display::measure_proportional_character(const char *s, int colNum, int pos) const {
     int charLen, style;
     char expChar[ FL_TEXT_MAX_EXP_CHAR_LEN ];
-    Fl_Text_Buffer *styleBuf = mStyleBuffer;
     
   charLen = Fl_Text_Buffer::expand_character(s, colNum, expChar, buffer()->tab_distance()); // FIXME: unicode
-    if (styleBuf == 0) {
+    if (mStyleBuffer == 0 && mStyleRuns == 0) {
 	style = 0;
     } else {
-      // FIXME: character is ucs-4
-	style = (unsigned char)styleBuf->character(pos);
-	if (style == mUnfinishedStyle && mUnfinishedHighlightCB) {
-    	    /* encountered "unfinished" style, trigger parsing */
-    	    (mUnfinishedHighlightCB)(pos, mHighlightCBArg);
-          // FIXME: character is ucs-4
-    	    style = (unsigned char)styleBuf->character(pos);
-	}
+	style = style_at(pos);
     }
     return string_width(expChar, charLen, style);
 }
@@ -0,0 +1,390 @@
+//
+// "$Id$"
+//
+// Line start index for Fl_Text_Buffer.
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <stdlib.h>
+#include "flstring.h"
+#include "Fl_Text_Line_Index.H"
+
+/*
+ The index always holds at least one line: an empty buffer is a single
+ line of length 0, and the last line is the only one that does not end in
+ a newline.  Blocks are never empty.  Blocks that overflow are rebuilt
+ half full, and a block that shrinks is merged with its successor when
+ both fit into one, so the number of blocks stays proportional to the
+ number of lines.  Whenever the number of blocks changes the Fenwick
+ trees are rebuilt, which is O(number of blocks) and rare compared to
+ the edits that only adjust one block.
+ */
+
+#define BLOCK_LINES 128
+#define BLOCK_FILL (BLOCK_LINES / 2)
+
+Fl_Text_Line_Index::Block *Fl_Text_Line_Index::new_block_()
+{
+  Block *b = (Block *) malloc(sizeof(Block) + (BLOCK_LINES - 1) * sizeof(int));
+  b->n = 0;
+  b->bytes = 0;
+  return b;
+}
+
+Fl_Text_Line_Index::Fl_Text_Line_Index()
+{
+  blocks_ = 0;
+  nblocks_ = ablocks_ = 0;
+  fw_lines_ = fw_bytes_ = 0;
+  clear();
+}
+
+Fl_Text_Line_Index::~Fl_Text_Line_Index()
+{
+  for (int b = 0; b < nblocks_; b++)
+    free(blocks_[b]);
+  free(blocks_);
+  free(fw_lines_);
+  free(fw_bytes_);
+}
+
+/** Resets the index to a single empty line. */
+void Fl_Text_Line_Index::clear()
+{
+  for (int b = 0; b < nblocks_; b++)
+    free(blocks_[b]);
+  nblocks_ = 0;
+  Block *blk = new_block_();
+  blk->n = 1;
+  blk->len[0] = 0;
+  reserve_(1);
+  blocks_[nblocks_++] = blk;
+  lines_ = 1;
+  bytes_ = 0;
+  rebuild_();
+}
+
+// Makes room for n blocks.
+void Fl_Text_Line_Index::reserve_(int n)
+{
+  if (n <= ablocks_)
+    return;
+  ablocks_ = ablocks_ ? ablocks_ : 16;
+  while (n > ablocks_) ablocks_ *= 2;
+  blocks_ = (Block **) realloc(blocks_, ablocks_ * sizeof(Block *));
+  fw_lines_ = (int *) realloc(fw_lines_, (ablocks_ + 1) * sizeof(int));
+  fw_bytes_ = (int *) realloc(fw_bytes_, (ablocks_ + 1) * sizeof(int));
+}
+
+// Merges block b with block b+1 if both fit into one.
+void Fl_Text_Line_Index::merge_(int b)
+{
+  if (b < 0 || b + 1 >= nblocks_)
+    return;
+  Block *a = blocks_[b], *c = blocks_[b + 1];
+  if (a->n + c->n > BLOCK_LINES)
+    return;
+  memcpy(a->len + a->n, c->len, c->n * sizeof(int));
+  a->n += c->n;
+  a->bytes += c->bytes;
+  free(c);
+  memmove(blocks_ + b + 1, blocks_ + b + 2, (nblocks_ - b - 2) * sizeof(Block *));
+  nblocks_--;
+}
+
+void Fl_Text_Line_Index::fw_add_(int b, int dlines, int dbytes)
+{
+  for (int i = b + 1; i <= nblocks_; i += i & -i) {
+    fw_lines_[i] += dlines;
+    fw_bytes_[i] += dbytes;
+  }
+}
+
+void Fl_Text_Line_Index::rebuild_()
+{
+  int i;
+  for (i = 1; i <= nblocks_; i++) {
+    fw_lines_[i] = blocks_[i - 1]->n;
+    fw_bytes_[i] = blocks_[i - 1]->bytes;
+  }
+  for (i = 1; i <= nblocks_; i++) {
+    int j = i + (i & -i);
+    if (j <= nblocks_) {
+      fw_lines_[j] += fw_lines_[i];
+      fw_bytes_[j] += fw_bytes_[i];
+    }
+  }
+}
+
+// Returns the block holding byte pos, and in base the offset of its
+// first byte.  The end of the text belongs to the last block.
+int Fl_Text_Line_Index::find_byte_(int pos, int *base) const
+{
+  int idx = 0, rem = pos, step = 1;
+  while (step * 2 <= nblocks_) step *= 2;
+  for (; step; step >>= 1) {
+    if (idx + step <= nblocks_ && fw_bytes_[idx + step] <= rem) {
+      idx += step;
+      rem -= fw_bytes_[idx];
+    }
+  }
+  if (idx >= nblocks_) {
+    idx = nblocks_ - 1;
+    rem = blocks_[idx]->bytes;
+  }
+  *base = pos - rem;
+  return idx;
+}
+
+// Returns the block holding line number line, and in base the number of
+// its first line.
+int Fl_Text_Line_Index::find_line_(int line, int *base) const
+{
+  int idx = 0, rem = line, step = 1;
+  while (step * 2 <= nblocks_) step *= 2;
+  for (; step; step >>= 1) {
+    if (idx + step <= nblocks_ && fw_lines_[idx + step] <= rem) {
+      idx += step;
+      rem -= fw_lines_[idx];
+    }
+  }
+  if (idx >= nblocks_) {
+    idx = nblocks_ - 1;
+    rem = blocks_[idx]->n - 1;
+  }
+  *base = line - rem;
+  return idx;
+}
+
+// Finds the line holding byte pos and the offset of pos inside it.
+void Fl_Text_Line_Index::locate_(int pos, int *line, int *off) const
+{
+  int base;
+  int b = find_byte_(pos, &base);
+  const Block *blk = blocks_[b];
+  int rem = pos - base, i;
+  for (i = 0; i < blk->n - 1 && rem >= blk->len[i]; i++)
+    rem -= blk->len[i];
+  int first = 0;
+  for (int j = b + 1; j > 0; j -= j & -j)
+    first += fw_lines_[j];
+  *line = first - blk->n + i;
+  *off = rem;
+}
+
+// Inserts k line lengths in front of line i of block b.
+void Fl_Text_Line_Index::insert_lines_(int b, int i, const int *lens, int k)
+{
+  int j, sum = 0;
+  for (j = 0; j < k; j++)
+    sum += lens[j];
+
+  if (blocks_[b]->n + k <= BLOCK_LINES) {
+    Block *blk = blocks_[b];
+    memmove(blk->len + i + k, blk->len + i, (blk->n - i) * sizeof(int));
+    memcpy(blk->len + i, lens, k * sizeof(int));
+    blk->n += k;
+    blk->bytes += sum;
+    fw_add_(b, k, sum);
+    lines_ += k;
+    bytes_ += sum;
+    return;
+  }
+
+  // merge the old block with the new lines and cut the result into
+  // half filled blocks
+  int total = blocks_[b]->n + k;
+  int nnew = (total + BLOCK_FILL - 1) / BLOCK_FILL;
+  reserve_(nblocks_ + nnew);
+
+  Block *old = blocks_[b];
+  int *all = (int *) malloc(total * sizeof(int));
+  memcpy(all, old->len, i * sizeof(int));
+  memcpy(all + i, lens, k * sizeof(int));
+  memcpy(all + i + k, old->len + i, (old->n - i) * sizeof(int));
+  free(old);
+
+  memmove(blocks_ + b + nnew, blocks_ + b + 1, (nblocks_ - b - 1) * sizeof(Block *));
+  for (j = 0; j < nnew; j++) {
+    Block *blk = new_block_();
+    int first = j * BLOCK_FILL;
+    blk->n = total - first < BLOCK_FILL ? total - first : BLOCK_FILL;
+    memcpy(blk->len, all + first, blk->n * sizeof(int));
+    for (int l = 0; l < blk->n; l++)
+      blk->bytes += blk->len[l];
+    blocks_[b + j] = blk;
+  }
+  free(all);
+  nblocks_ += nnew - 1;
+  lines_ += k;
+  bytes_ += sum;
+  rebuild_();
+}
+
+// Removes k lines starting with line number line.
+void Fl_Text_Line_Index::remove_lines_(int line, int k)
+{
+  int base;
+  int first = find_line_(line, &base);
+  int b = first, i = line - base, dropped = 0;
+  while (k > 0) {
+    Block *blk = blocks_[b];
+    int c = blk->n - i;
+    if (c > k) c = k;
+    int sum = 0;
+    for (int j = i; j < i + c; j++)
+      sum += blk->len[j];
+    memmove(blk->len + i, blk->len + i + c, (blk->n - i - c) * sizeof(int));
+    blk->n -= c;
+    blk->bytes -= sum;
+    lines_ -= c;
+    bytes_ -= sum;
+    k -= c;
+    if (!blk->n) {
+      free(blk);
+      blocks_[b] = 0;
+      dropped++;
+    }
+    b++;
+    i = 0;
+  }
+
+  // close the gap left by emptied blocks
+  if (dropped) {
+    int to = first;
+    for (int from = first; from < nblocks_; from++)
+      if (blocks_[from]) blocks_[to++] = blocks_[from];
+    nblocks_ = to;
+  }
+
+  // merge the blocks around the cut if they have become small
+  merge_(first);
+  merge_(first - 1);
+  rebuild_();
+}
+
+// Changes the length of line number line.
+void Fl_Text_Line_Index::set_length_(int line, int len)
+{
+  int base;
+  int b = find_line_(line, &base);
+  Block *blk = blocks_[b];
+  int d = len - blk->len[line - base];
+  blk->len[line - base] = len;
+  blk->bytes += d;
+  bytes_ += d;
+  fw_add_(b, 0, d);
+}
+
+/** Updates the index for \p len bytes of \p text inserted at \p pos. */
+void Fl_Text_Line_Index::insert(int pos, const char *text, int len)
+{
+  if (len <= 0)
+    return;
+  int line, off;
+  locate_(pos, &line, &off);
+  const char *nl = (const char *) memchr(text, '\n', len);
+  int base;
+  int b = find_line_(line, &base);
+  int old = blocks_[b]->len[line - base];
+  if (!nl) {
+    set_length_(line, old + len);
+    return;
+  }
+
+  // the line at pos ends with the first inserted newline, every further
+  // newline ends a new line, and the last new line gets the rest of the
+  // line that was split
+  int k = 0, a = 16;
+  int *lens = (int *) malloc(a * sizeof(int));
+  const char *end = text + len, *p = nl + 1;
+  set_length_(line, off + int(p - text));
+  for (;;) {
+    const char *q = (const char *) memchr(p, '\n', end - p);
+    if (k == a) {
+      a *= 2;
+      lens = (int *) realloc(lens, a * sizeof(int));
+    }
+    if (!q) {
+      lens[k++] = int(end - p) + old - off;
+      break;
+    }
+    lens[k++] = int(q - p) + 1;
+    p = q + 1;
+  }
+  b = find_line_(line, &base);
+  insert_lines_(b, line - base + 1, lens, k);
+  free(lens);
+}
+
+/** Updates the index for the bytes between \p start and \p end removed. */
+void Fl_Text_Line_Index::remove(int start, int end)
+{
+  if (end <= start)
+    return;
+  int ls, os, le, oe, base;
+  locate_(start, &ls, &os);
+  locate_(end, &le, &oe);
+  int b = find_line_(le, &base);
+  int tail = blocks_[b]->len[le - base] - oe;
+  if (le > ls)
+    remove_lines_(ls + 1, le - ls);
+  set_length_(ls, os + tail);
+}
+
+/** Returns the number of newlines in front of byte offset \p pos. */
+int Fl_Text_Line_Index::line_of(int pos) const
+{
+  if (pos <= 0)
+    return 0;
+  if (pos > bytes_)
+    pos = bytes_;
+  int line, off;
+  locate_(pos, &line, &off);
+  return line;
+}
+
+/**
+ Returns the byte offset of the first character of line number \p line,
+ or the length of the text if there is no such line.
+ */
+int Fl_Text_Line_Index::line_start(int line) const
+{
+  if (line <= 0)
+    return 0;
+  if (line >= lines_)
+    return bytes_;
+  int base;
+  int b = find_line_(line, &base);
+  int pos = 0;
+  for (int j = b; j > 0; j -= j & -j)
+    pos += fw_bytes_[j];
+  const Block *blk = blocks_[b];
+  for (int i = 0; i < line - base; i++)
+    pos += blk->len[i];
+  return pos;
+}
+
+//
+// End of "$Id$".
+//
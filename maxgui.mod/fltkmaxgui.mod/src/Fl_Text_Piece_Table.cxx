@@ -0,0 +1,307 @@
+//
+// "$Id$"
+//
+// Piece table storage for Fl_Text_Buffer.
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <stdlib.h>
+#include "flstring.h"
+#include "Fl_Text_Piece_Table.H"
+
+/*
+ Text is never modified once it has been stored: inserted strings are
+ appended to the current chunk and removals only drop pieces.  Consecutive
+ insertions at the end of the piece that was filled last (typing, or
+ appending to a log) simply grow that piece, so the number of pieces stays
+ proportional to the number of distinct edit locations, not to the number
+ of edits.
+
+ Since removed text stays in its chunk, the live text is copied into one
+ fresh chunk once it has shrunk to a quarter of the bytes stored, so a
+ buffer that is trimmed as it grows (a log) uses bounded memory.  The
+ copy is paid for by the removals that came before it.
+
+ Pieces are only ever split at positions handed in by Fl_Text_Buffer, which
+ are character aligned, so a UTF-8 sequence never straddles two pieces and
+ span() can be used to read a whole character.
+ */
+
+#define CHUNK_SIZE 65536
+
+Fl_Text_Piece_Table::Fl_Text_Piece_Table()
+{
+  root_ = 0;
+  chunks_ = 0;
+  stored_ = 0;
+  npieces_ = 0;
+  seed_ = 2463534242U;
+}
+
+Fl_Text_Piece_Table::~Fl_Text_Piece_Table()
+{
+  clear();
+}
+
+/** Removes all text and releases the chunks. */
+void Fl_Text_Piece_Table::clear()
+{
+  free_tree_(root_);
+  root_ = 0;
+  while (chunks_) {
+    Chunk *c = chunks_;
+    chunks_ = c->next;
+    free(c);
+  }
+  stored_ = 0;
+}
+
+unsigned Fl_Text_Piece_Table::random_()
+{
+  seed_ ^= seed_ << 13;
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  return seed_;
+}
+
+Fl_Text_Piece_Table::Piece *Fl_Text_Piece_Table::new_piece_(const char *data, int len)
+{
+  Piece *p = new Piece;
+  p->data = data;
+  p->len = p->size = len;
+  p->prio = random_();
+  p->left = p->right = 0;
+  npieces_++;
+  return p;
+}
+
+void Fl_Text_Piece_Table::free_tree_(Piece *p)
+{
+  while (p) {
+    Piece *r = p->right;
+    free_tree_(p->left);
+    delete p;
+    npieces_--;
+    p = r;
+  }
+}
+
+Fl_Text_Piece_Table::Piece *Fl_Text_Piece_Table::merge_(Piece *l, Piece *r)
+{
+  if (!l) return r;
+  if (!r) return l;
+  if (l->prio > r->prio) {
+    l->right = merge_(l->right, r);
+    update_(l);
+    return l;
+  }
+  r->left = merge_(l, r->left);
+  update_(r);
+  return r;
+}
+
+// Splits t into the first pos bytes (l) and the rest (r), cutting a piece
+// in two if pos falls inside it.
+void Fl_Text_Piece_Table::split_(Piece *t, int pos, Piece *&l, Piece *&r)
+{
+  if (!t) {
+    l = r = 0;
+    return;
+  }
+  int ls = size_(t->left);
+  if (pos <= ls) {
+    split_(t->left, pos, l, t->left);
+    update_(t);
+    r = t;
+  } else if (pos >= ls + t->len) {
+    split_(t->right, pos - ls - t->len, t->right, r);
+    update_(t);
+    l = t;
+  } else {
+    int off = pos - ls;
+    Piece *p = new_piece_(t->data + off, t->len - off);
+    t->len = off;
+    r = merge_(p, t->right);
+    t->right = 0;
+    update_(t);
+    l = t;
+  }
+}
+
+// Grows the piece that ends at pos by n bytes if its text continues at
+// tail.  Returns 1 and fixes up the subtree sizes on success.
+int Fl_Text_Piece_Table::extend_(Piece *t, int pos, const char *tail, int n)
+{
+  if (!t)
+    return 0;
+  int ls = size_(t->left);
+  int ok;
+  if (pos <= ls)
+    ok = extend_(t->left, pos, tail, n);
+  else if (pos == ls + t->len) {
+    ok = (t->data + t->len == tail);
+    if (ok) t->len += n;
+  } else if (pos > ls + t->len)
+    ok = extend_(t->right, pos - ls - t->len, tail, n);
+  else
+    ok = 0;
+  if (ok)
+    t->size += n;
+  return ok;
+}
+
+// Copies text to the end of the current chunk, starting a new one if it
+// does not fit, and returns where it was stored.
+const char *Fl_Text_Piece_Table::store_(const char *text, int len)
+{
+  Chunk *c = chunks_;
+  if (!c || c->alloc - c->used < len) {
+    int alloc = len > CHUNK_SIZE ? len : CHUNK_SIZE;
+    c = (Chunk *) malloc(sizeof(Chunk) + alloc);
+    c->next = chunks_;
+    c->alloc = alloc;
+    c->used = 0;
+    chunks_ = c;
+  }
+  char *dst = c->data + c->used;
+  memcpy(dst, text, len);
+  c->used += len;
+  stored_ += len;
+  return dst;
+}
+
+// Replaces all chunks and pieces by a single piece in a new chunk.
+void Fl_Text_Piece_Table::compact_()
+{
+  int len = length();
+  int alloc = len > CHUNK_SIZE ? len : CHUNK_SIZE;
+  Chunk *c = (Chunk *) malloc(sizeof(Chunk) + alloc);
+  if (!c)
+    return;
+  c->next = 0;
+  c->alloc = alloc;
+  c->used = len;
+  copy(c->data, 0, len);
+  clear();
+  chunks_ = c;
+  stored_ = len;
+  if (len)
+    root_ = new_piece_(c->data, len);
+}
+
+/** Inserts \p len bytes of \p text at byte offset \p pos. */
+void Fl_Text_Piece_Table::insert(int pos, const char *text, int len)
+{
+  if (len <= 0)
+    return;
+  const char *data = store_(text, len);
+  if (extend_(root_, pos, data, len))
+    return;
+  Piece *l, *r;
+  split_(root_, pos, l, r);
+  root_ = merge_(merge_(l, new_piece_(data, len)), r);
+}
+
+/** Removes the bytes between \p start and \p end. */
+void Fl_Text_Piece_Table::remove(int start, int end)
+{
+  if (end <= start)
+    return;
+  Piece *l, *m, *r;
+  split_(root_, start, l, r);
+  split_(r, end - start, m, r);
+  free_tree_(m);
+  root_ = merge_(l, r);
+  if (stored_ > 2 * CHUNK_SIZE && length() < stored_ / 4)
+    compact_();
+}
+
+/** Copies the bytes between \p start and \p end to \p dst. */
+void Fl_Text_Piece_Table::copy(char *dst, int start, int end) const
+{
+  while (start < end) {
+    int n;
+    const char *src = span(start, &n);
+    if (n > end - start)
+      n = end - start;
+    memcpy(dst, src, n);
+    dst += n;
+    start += n;
+  }
+}
+
+// Finds the piece holding the byte at pos and its offset inside it.
+const Fl_Text_Piece_Table::Piece *Fl_Text_Piece_Table::find_(int pos, int *off) const
+{
+  const Piece *t = root_;
+  while (t) {
+    int ls = size_(t->left);
+    if (pos < ls)
+      t = t->left;
+    else if (pos < ls + t->len) {
+      *off = pos - ls;
+      return t;
+    } else {
+      pos -= ls + t->len;
+      t = t->right;
+    }
+  }
+  return 0;
+}
+
+/**
+ Returns the address of the byte at \p pos and in \p len the number of
+ bytes that can be read from there without crossing into another piece.
+ */
+const char *Fl_Text_Piece_Table::span(int pos, int *len) const
+{
+  int off;
+  const Piece *t = find_(pos, &off);
+  if (!t) {
+    *len = 0;
+    return "";
+  }
+  *len = t->len - off;
+  return t->data + off;
+}
+
+/**
+ Returns the address of the byte at \p pos and in \p len the number of
+ bytes that can be read backwards from there (including the byte at
+ \p pos) without crossing into another piece.
+ */
+const char *Fl_Text_Piece_Table::span_back(int pos, int *len) const
+{
+  int off;
+  const Piece *t = find_(pos, &off);
+  if (!t) {
+    *len = 0;
+    return "";
+  }
+  *len = off + 1;
+  return t->data + off;
+}
+
+//
+// End of "$Id$".
+//
@@ -0,0 +1,247 @@
+//
+// "$Id$"
+//
+// Run-length encoded style information for Fl_Text_Display.
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <stdlib.h>
+#include <FL/Fl_Text_Style_Runs.H>
+
+/*
+ Neighbouring runs with the same style are joined whenever an edit brings
+ them together, so the number of runs never exceeds the number of style
+ changes in the text plus the number of distinct edits that did not
+ coalesce.
+ */
+
+Fl_Text_Style_Runs::Fl_Text_Style_Runs()
+{
+  root_ = 0;
+  nruns_ = 0;
+  seed_ = 2463534242U;
+  cacheStart_ = cacheEnd_ = 0;
+}
+
+Fl_Text_Style_Runs::~Fl_Text_Style_Runs()
+{
+  clear();
+}
+
+/** Removes all runs. */
+void Fl_Text_Style_Runs::clear()
+{
+  free_tree_(root_);
+  root_ = 0;
+  cacheEnd_ = 0;
+}
+
+unsigned Fl_Text_Style_Runs::random_()
+{
+  seed_ ^= seed_ << 13;
+  seed_ ^= seed_ >> 17;
+  seed_ ^= seed_ << 5;
+  return seed_;
+}
+
+Fl_Text_Style_Runs::Run *Fl_Text_Style_Runs::new_run_(int len, int style)
+{
+  Run *r = new Run;
+  r->len = r->size = len;
+  r->style = style;
+  r->prio = random_();
+  r->left = r->right = 0;
+  nruns_++;
+  return r;
+}
+
+void Fl_Text_Style_Runs::free_tree_(Run *r)
+{
+  while (r) {
+    Run *next = r->right;
+    free_tree_(r->left);
+    delete r;
+    nruns_--;
+    r = next;
+  }
+}
+
+Fl_Text_Style_Runs::Run *Fl_Text_Style_Runs::merge_(Run *l, Run *r)
+{
+  if (!l) return r;
+  if (!r) return l;
+  if (l->prio > r->prio) {
+    l->right = merge_(l->right, r);
+    update_(l);
+    return l;
+  }
+  r->left = merge_(l, r->left);
+  update_(r);
+  return r;
+}
+
+// Removes the first run of t and returns the new root.
+Fl_Text_Style_Runs::Run *Fl_Text_Style_Runs::drop_first_(Run *t)
+{
+  if (!t->left) {
+    Run *r = t->right;
+    delete t;
+    nruns_--;
+    return r;
+  }
+  t->left = drop_first_(t->left);
+  update_(t);
+  return t;
+}
+
+// Like merge_(), but folds the first run of r into the last run of l if
+// they have the same style.
+Fl_Text_Style_Runs::Run *Fl_Text_Style_Runs::join_(Run *l, Run *r)
+{
+  if (l && r) {
+    Run *a = l, *b = r;
+    while (a->right) a = a->right;
+    while (b->left) b = b->left;
+    if (a->style == b->style) {
+      int n = b->len;
+      r = drop_first_(r);
+      for (a = l; a; a = a->right) {
+        a->size += n;
+        if (!a->right) a->len += n;
+      }
+    }
+  }
+  return merge_(l, r);
+}
+
+// Splits t into the first pos bytes (l) and the rest (r), cutting a run
+// in two if pos falls inside it.
+void Fl_Text_Style_Runs::split_(Run *t, int pos, Run *&l, Run *&r)
+{
+  if (!t) {
+    l = r = 0;
+    return;
+  }
+  int ls = size_(t->left);
+  if (pos <= ls) {
+    split_(t->left, pos, l, t->left);
+    update_(t);
+    r = t;
+  } else if (pos >= ls + t->len) {
+    split_(t->right, pos - ls - t->len, t->right, r);
+    update_(t);
+    l = t;
+  } else {
+    int off = pos - ls;
+    Run *n = new_run_(t->len - off, t->style);
+    t->len = off;
+    r = merge_(n, t->right);
+    t->right = 0;
+    update_(t);
+    l = t;
+  }
+}
+
+/** Inserts \p len bytes of style \p style at byte offset \p pos. */
+void Fl_Text_Style_Runs::insert(int pos, int len, int style)
+{
+  if (len <= 0)
+    return;
+  if (pos < 0) pos = 0;
+  Run *l, *r;
+  split_(root_, pos, l, r);
+  root_ = join_(join_(l, new_run_(len, style)), r);
+  cacheEnd_ = 0;
+}
+
+/** Removes the styles of the bytes between \p start and \p end. */
+void Fl_Text_Style_Runs::remove(int start, int end)
+{
+  if (start < 0) start = 0;
+  if (end > length()) end = length();
+  if (end <= start)
+    return;
+  Run *l, *m, *r;
+  split_(root_, start, l, r);
+  split_(r, end - start, m, r);
+  free_tree_(m);
+  root_ = join_(l, r);
+  cacheEnd_ = 0;
+}
+
+/**
+ Changes the style of the bytes between \p start and \p end to \p style.
+ The runs are not extended if \p end is past their end.
+ */
+void Fl_Text_Style_Runs::set(int start, int end, int style)
+{
+  if (start < 0) start = 0;
+  if (end > length()) end = length();
+  if (end <= start)
+    return;
+  Run *l, *m, *r;
+  split_(root_, start, l, r);
+  split_(r, end - start, m, r);
+  free_tree_(m);
+  root_ = join_(join_(l, new_run_(end - start, style)), r);
+  cacheEnd_ = 0;
+}
+
+/**
+ Returns the style of the byte at \p pos, or 0 if \p pos is outside of the
+ runs.  If \p runStart and \p runEnd are given, they are set to the range of
+ bytes that share this style.
+ */
+int Fl_Text_Style_Runs::style(int pos, int *runStart, int *runEnd) const
+{
+  if (pos < cacheStart_ || pos >= cacheEnd_) {
+    const Run *t = root_;
+    int base = 0;
+    while (t) {
+      int ls = size_(t->left);
+      if (pos < base + ls)
+        t = t->left;
+      else if (pos < base + ls + t->len)
+        break;
+      else {
+        base += ls + t->len;
+        t = t->right;
+      }
+    }
+    if (!t || pos < 0) {
+      if (runStart) *runStart = pos;
+      if (runEnd) *runEnd = pos + 1;
+      return 0;
+    }
+    cacheStart_ = base + size_(t->left);
+    cacheEnd_ = cacheStart_ + t->len;
+    cacheStyle_ = t->style;
+  }
+  if (runStart) *runStart = cacheStart_;
+  if (runEnd) *runEnd = cacheEnd_;
+  return cacheStyle_;
+}
+
+//
+// End of "$Id$".
+//
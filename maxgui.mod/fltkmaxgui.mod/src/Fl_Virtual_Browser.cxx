@@ -0,0 +1,434 @@
+//
+// "$Id$"
+//
+// Virtual browser widget for the Fast Light Tool Kit (FLTK).
+//
+// Copyright 1998-2010 by Bill Spitzak and others.
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Library General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Library General Public License for more details.
+//
+// You should have received a copy of the GNU Library General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307
+// USA.
+//
+// Please report all bugs and problems on the following page:
+//
+//     http://www.fltk.org/str.php
+//
+
+#include <FL/Fl.H>
+#include <FL/Fl_Virtual_Browser.H>
+#include <FL/fl_draw.H>
+#include "flstring.h"
+#include <stdlib.h>
+
+// The items handed to Fl_Browser_ are the line numbers themselves, cast
+// to pointers, so there is nothing to allocate per line.  The contents of
+// the lines are fetched from the provider into a cache of nrows_ entries,
+// which are found through a hash table on the line number and reused in
+// least recently used order.  The entries form a ring through prev/next,
+// with recent_ the most recently used one and its prev the least.
+
+#define LINE(item) ((int)(size_t)(item))
+#define ITEM(line) ((void*)(size_t)(line))
+
+#define DEFAULT_CACHE_SIZE 256
+
+struct Fl_Virtual_Browser::Row {
+  int line;		// line held by this entry, 0 if none
+  char *text;
+  int size;		// allocated size of text
+  Fl_Image *icon;
+  void *data;
+  int prev, next;	// LRU ring
+  int hnext;		// next entry in the same hash chain
+};
+
+static const int no_columns[1] = {0};
+
+/**
+  The constructor makes an empty browser.
+  \param[in] X,Y,W,H position and size.
+  \param[in] L label string, may be NULL.
+*/
+Fl_Virtual_Browser::Fl_Virtual_Browser(int X, int Y, int W, int H, const char *L)
+: Fl_Browser_(X, Y, W, H, L) {
+  lines_ = 0;
+  provider_ = 0;
+  provider_arg_ = 0;
+  rows_ = 0;
+  nrows_ = DEFAULT_CACHE_SIZE;
+  hash_ = 0;
+  recent_ = 0;
+  filling_ = 0;
+  selected_ = 0;
+  line_height_ = 0;
+  column_widths_ = no_columns;
+  column_char_ = '\t';
+}
+
+/**
+  The destructor frees the cache and destroys the browser.
+*/
+Fl_Virtual_Browser::~Fl_Virtual_Browser() {
+  free_cache();
+  free(selected_);
+}
+
+void Fl_Virtual_Browser::free_cache() {
+  if (rows_) {
+    for (int i = 0; i < nrows_; i++) free(rows_[i].text);
+    free(rows_);
+    free(hash_);
+  }
+  rows_ = 0;
+  hash_ = 0;
+}
+
+// Removes entry i from its hash chain:
+void Fl_Virtual_Browser::unhash(int i) {
+  Row *r = rows_ + i;
+  if (!r->line) return;
+  int *p = hash_ + r->line % (2*nrows_);
+  while (*p != i) p = &rows_[*p].hnext;
+  *p = r->hnext;
+  r->line = 0;
+}
+
+// Makes entry i the most recently used one:
+void Fl_Virtual_Browser::touch(int i) {
+  if (i == recent_) return;
+  Row *r = rows_ + i;
+  rows_[r->prev].next = r->next;
+  rows_[r->next].prev = r->prev;
+  Row *h = rows_ + recent_;
+  r->next = recent_;
+  r->prev = h->prev;
+  rows_[h->prev].next = i;
+  h->prev = i;
+  recent_ = i;
+}
+
+// Returns the cache entry for line, asking the provider for it if needed:
+Fl_Virtual_Browser::Row *Fl_Virtual_Browser::row(int line) const {
+  Fl_Virtual_Browser *b = (Fl_Virtual_Browser*)this;
+  int i;
+  if (!rows_) {
+    b->rows_ = (Row*)calloc(nrows_, sizeof(Row));
+    b->hash_ = (int*)malloc(2*nrows_*sizeof(int));
+    for (i = 0; i < 2*nrows_; i++) hash_[i] = -1;
+    for (i = 0; i < nrows_; i++) {
+      rows_[i].prev = (i + nrows_ - 1) % nrows_;
+      rows_[i].next = (i + 1) % nrows_;
+    }
+    b->recent_ = 0;
+  }
+  int *head = hash_ + line % (2*nrows_);
+  for (i = *head; i >= 0; i = rows_[i].hnext)
+    if (rows_[i].line == line) {
+      b->touch(i);
+      return rows_ + i;
+    }
+  // reuse the least recently used entry:
+  i = rows_[recent_].prev;
+  b->unhash(i);
+  Row *r = rows_ + i;
+  r->line = line;
+  r->hnext = *head;
+  *head = i;
+  if (r->text) r->text[0] = 0;
+  r->icon = 0;
+  r->data = 0;
+  b->touch(i);
+  if (provider_) {
+    Row *f = filling_;
+    b->filling_ = r;
+    provider_(b, line, provider_arg_);
+    b->filling_ = f;
+  }
+  return r;
+}
+
+/**
+  Sets the number of lines to \p n.  Lines that are added start out
+  deselected, and lines beyond \p n are dropped from the cache.
+  The lines that are kept are not requested again; call changed() if
+  their contents changed as well.
+*/
+void Fl_Virtual_Browser::size(int n) {
+  if (n < 0) n = 0;
+  if (n == lines_) return;
+  int oldbytes = (lines_+7)/8, bytes = (n+7)/8;
+  if (bytes != oldbytes) {
+    selected_ = (unsigned char*)realloc(selected_, bytes ? bytes : 1);
+    if (bytes > oldbytes) memset(selected_+oldbytes, 0, bytes-oldbytes);
+  }
+  if (n < lines_) {
+    if (n & 7) selected_[n/8] &= (1 << (n&7)) - 1;
+    if (rows_)
+      for (int i = 0; i < nrows_; i++)
+        if (rows_[i].line > n) unhash(i);
+    // forget the top and selected lines if they went away:
+    if (LINE(top()) > n || LINE(selection()) > n) new_list();
+  }
+  lines_ = n;
+  redraw();
+}
+
+/**
+  Sets the function that supplies the contents of the lines, and forgets
+  all cached lines.
+  \param[in] p The provider, see Fl_Virtual_Browser_Provider.
+  \param[in] arg Passed to \p p.
+*/
+void Fl_Virtual_Browser::provider(Fl_Virtual_Browser_Provider *p, void *arg) {
+  provider_ = p;
+  provider_arg_ = arg;
+  changed();
+}
+
+/**
+  Describes the line the provider was asked for.  This may only be called
+  from the provider; \p text is copied, \p icon and \p data are not.
+*/
+void Fl_Virtual_Browser::set_line(const char *text, Fl_Image *icon, void *data) {
+  Row *r = filling_;
+  if (!r) return;
+  if (!text) text = "";
+  int l = strlen(text) + 1;
+  if (l > r->size) {
+    r->size = l + 15;
+    r->text = (char*)realloc(r->text, r->size);
+  }
+  memcpy(r->text, text, l);
+  r->icon = icon;
+  r->data = data;
+}
+
+/**
+  Tells the browser that the contents of \p line changed, so it is
+  requested from the provider again when needed.
+  A \p line of 0 means that all lines changed.
+*/
+void Fl_Virtual_Browser::changed(int line) {
+  if (rows_) {
+    for (int i = 0; i < nrows_; i++)
+      if (!line || rows_[i].line == line) unhash(i);
+  }
+  if (line) redraw_line(ITEM(line));
+  else redraw();
+}
+
+/**
+  Sets the number of lines kept in the cache.  It should be at least the
+  number of lines that fit in the browser.  The default is 256.
+*/
+void Fl_Virtual_Browser::cache_size(int n) {
+  if (n < 16) n = 16;
+  if (n == nrows_) return;
+  free_cache();
+  nrows_ = n;
+  redraw();
+}
+
+/**
+  Returns the height of every line in pixels.
+  \see line_height(int)
+*/
+int Fl_Virtual_Browser::line_height() const {
+  if (line_height_) return line_height_;
+  fl_font(textfont(), textsize());
+  return fl_height() > 2 ? fl_height() : 2;
+}
+
+/**
+  Returns the text of \p line, or NULL if \p line is out of range.
+  The string is only valid until other lines are requested.
+*/
+const char *Fl_Virtual_Browser::text(int line) const {
+  if (line < 1 || line > lines_) return 0;
+  Row *r = row(line);
+  return r->text ? r->text : "";
+}
+
+/**
+  Returns the data of \p line, or NULL if \p line is out of range.
+*/
+void *Fl_Virtual_Browser::data(int line) const {
+  if (line < 1 || line > lines_) return 0;
+  return row(line)->data;
+}
+
+/**
+  Returns the icon of \p line, or NULL if it has none.
+*/
+Fl_Image *Fl_Virtual_Browser::icon(int line) const {
+  if (line < 1 || line > lines_) return 0;
+  return row(line)->icon;
+}
+
+/**
+  Sets the selection state of \p line.
+  \param[in] line The line to change. (1 based)
+  \param[in] val 1 selects, 0 deselects.
+  \returns 1 if the state changed, 0 if not.
+*/
+int Fl_Virtual_Browser::select(int line, int val) {
+  if (line < 1 || line > lines_) return 0;
+  return Fl_Browser_::select(ITEM(line), val);
+}
+
+/**
+  Returns 1 if \p line is selected, 0 if not.
+*/
+int Fl_Virtual_Browser::selected(int line) const {
+  if (line < 1 || line > lines_) return 0;
+  return item_selected(ITEM(line));
+}
+
+/**
+  Returns the selected line, or for a multi browser the line with the
+  focus, or 0 if there is none.
+*/
+int Fl_Virtual_Browser::value() const {
+  return LINE(selection());
+}
+
+/**
+  Scrolls the browser so \p line is at the top.
+*/
+void Fl_Virtual_Browser::topline(int line) {
+  if (line > lines_) line = lines_;
+  if (line < 1) line = 1;
+  position((line-1)*line_height());
+}
+
+/**
+  Scrolls the browser as little as needed to show \p line.
+*/
+void Fl_Virtual_Browser::make_visible(int line) {
+  if (line > lines_) line = lines_;
+  if (line < 1) return;
+  int X, Y, W, H; bbox(X, Y, W, H);
+  int hh = line_height();
+  int p = (line-1)*hh;
+  if (p < position()) position(p);
+  else if (p+hh > position()+H) position(p+hh-H);
+}
+
+void *Fl_Virtual_Browser::item_first() const {
+  return lines_ ? ITEM(1) : 0;
+}
+
+void *Fl_Virtual_Browser::item_next(void *item) const {
+  return LINE(item) < lines_ ? ITEM(LINE(item)+1) : 0;
+}
+
+void *Fl_Virtual_Browser::item_prev(void *item) const {
+  return LINE(item) > 1 ? ITEM(LINE(item)-1) : 0;
+}
+
+void *Fl_Virtual_Browser::item_last() const {
+  return lines_ ? ITEM(lines_) : 0;
+}
+
+void *Fl_Virtual_Browser::item_at(int line) const {
+  return (line >= 1 && line <= lines_) ? ITEM(line) : 0;
+}
+
+int Fl_Virtual_Browser::item_height(void *) const {
+  return line_height();
+}
+
+int Fl_Virtual_Browser::item_uniform_height() const {
+  return line_height();
+}
+
+int Fl_Virtual_Browser::full_height() const {
+  return lines_ * line_height();
+}
+
+int Fl_Virtual_Browser::incr_height() const {
+  return line_height();
+}
+
+const char *Fl_Virtual_Browser::item_text(void *item) const {
+  return text(LINE(item));
+}
+
+void *Fl_Virtual_Browser::item_data(void *item) const {
+  return data(LINE(item));
+}
+
+void Fl_Virtual_Browser::item_select(void *item, int val) {
+  int line = LINE(item) - 1;
+  if (val) selected_[line/8] |= 1 << (line&7);
+  else selected_[line/8] &= ~(1 << (line&7));
+}
+
+int Fl_Virtual_Browser::item_selected(void *item) const {
+  int line = LINE(item) - 1;
+  return (selected_[line/8] >> (line&7)) & 1;
+}
+
+int Fl_Virtual_Browser::item_width(void *item) const {
+  Row *r = row(LINE(item));
+  const char *str = r->text ? r->text : "";
+  const int *i = column_widths();
+  int ww = 0;
+  while (*i) { // add up all the full columns
+    const char *e = strchr(str, column_char());
+    if (!e) break;
+    str = e+1;
+    ww += *i++;
+  }
+  if (ww == 0 && r->icon) ww = r->icon->w()+2;
+  fl_font(textfont(), textsize());
+  return ww + int(fl_width(str)) + 6;
+}
+
+void Fl_Virtual_Browser::item_draw(void *item, int X, int Y, int W, int H) const {
+  Row *r = row(LINE(item));
+  char *str = r->text;
+  const int *i = column_widths();
+  Fl_Color lcol = textcolor();
+  if (item_selected(item)) lcol = fl_contrast(lcol, selection_color());
+  if (!active_r()) lcol = fl_inactive(lcol);
+  int iconw = 0;
+  if (r->icon) {
+    r->icon->draw(X+2, Y+1);	// leave 2px left, 1px above
+    iconw = r->icon->w()+2;
+    X += iconw; W -= iconw;
+  }
+  if (!str) return;
+  fl_font(textfont(), textsize());
+  fl_color(lcol);
+  while (W > 6) {	// do each column
+    int w1 = W;
+    char *e = 0;
+    if (*i) { // find end of column and temporarily replace with 0
+      e = strchr(str, column_char());
+      if (e) {*e = 0; w1 = *i++ - iconw;}
+    }
+    iconw = 0;	// the icon only takes space from the first column
+    fl_draw(str, X+3, Y, w1-6, H, e ? Fl_Align(FL_ALIGN_LEFT|FL_ALIGN_CLIP) : FL_ALIGN_LEFT, 0, 0);
+    if (!e) break;
+    *e = column_char(); // put the separator back
+    X += w1;
+    W -= w1;
+    str = e+1;
+  }
+}
+
+//
+// End of "$Id$".
+//
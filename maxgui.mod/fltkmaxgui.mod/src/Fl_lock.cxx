@@ -67,58 +67,76 @@
    returns the most recent value!
 */
 
-#ifndef FL_DOXYGEN
-Fl_Awake_Handler *Fl::awake_ring_;
-void **Fl::awake_data_;
-int Fl::awake_ring_size_;
-int Fl::awake_ring_head_;
-int Fl::awake_ring_tail_;
-#endif
+/*
+   Awake callbacks are kept in an unbounded lock-free queue with any
+   number of producers and one consumer, the main thread (this is
+   Dmitry Vyukov's MPSC queue). A producer appends a node with
+   one atomic exchange of the head, so threads posting at a high rate
+   never wait for each other or for the main thread, and never find
+   the queue full.
+
+   The main thread is only woken for the first message of a batch:
+   awake_pending is set by the producer that finds it clear, and the
+   consumer clears it once it has found the queue empty, so a single
+   write to the wake-up pipe (or a single posted message on WIN32)
+   covers everything queued until the main thread gets around to it,
+   and the main thread then runs the whole batch.
+*/
 
-static const int AWAKE_RING_SIZE = 1024;
-static void lock_ring();
-static void unlock_ring();
+struct Fl_Awake_Node {
+  Fl_Awake_Node * volatile next;
+  Fl_Awake_Handler func;
+  void *data;
+};
 
+static Fl_Awake_Node awake_stub;
+static Fl_Awake_Node * volatile awake_head = &awake_stub; // producers append here
+static Fl_Awake_Node *awake_tail = &awake_stub;          // main thread takes from here
+static volatile int awake_pending;
+
+static void wake_main_thread();
+
+// Exchange with a full memory barrier, which __sync_lock_test_and_set()
+// does not promise everywhere
+static Fl_Awake_Node *exchange_head(Fl_Awake_Node *n) {
+  Fl_Awake_Node *o;
+  do o = awake_head; while (!__sync_bool_compare_and_swap(&awake_head, o, n));
+  return o;
+}
 
 /** Adds an awake handler for use in awake(). */
 int Fl::add_awake_handler_(Fl_Awake_Handler func, void *data)
 {
-  int ret = 0;
-  lock_ring();
-  if (!awake_ring_) {
-    awake_ring_size_ = AWAKE_RING_SIZE;
-    awake_ring_ = (Fl_Awake_Handler*)malloc(awake_ring_size_*sizeof(Fl_Awake_Handler));
-    awake_data_ = (void**)malloc(awake_ring_size_*sizeof(void*));
-  }
-  if (awake_ring_head_==awake_ring_tail_-1 || awake_ring_head_+1==awake_ring_tail_) {
-    // ring is full. Return -1 as an error indicator.
-    ret = -1;
-  } else {
-    awake_ring_[awake_ring_head_] = func;
-    awake_data_[awake_ring_head_] = data;
-    ++awake_ring_head_;
-    if (awake_ring_head_ == awake_ring_size_)
-      awake_ring_head_ = 0;
-  }
-  unlock_ring();
-  return ret;
+  Fl_Awake_Node *n = (Fl_Awake_Node*)malloc(sizeof(Fl_Awake_Node));
+  if (!n) return -1;
+  n->next = 0;
+  n->func = func;
+  n->data = data;
+  exchange_head(n)->next = n;
+  // only the first message since the main thread emptied the queue wakes it
+  if (__sync_bool_compare_and_swap(&awake_pending, 0, 1)) wake_main_thread();
+  return 0;
 }
-/** Gets the last stored awake handler for use in awake(). */
+/** Gets the oldest stored awake handler for use in awake().
+    Must only be called by the main thread. */
 int Fl::get_awake_handler_(Fl_Awake_Handler &func, void *&data)
 {
-  int ret = 0;
-  lock_ring();
-  if (!awake_ring_ || awake_ring_head_ == awake_ring_tail_) {
-    ret = -1;
-  } else {
-    func = awake_ring_[awake_ring_tail_];
-    data = awake_data_[awake_ring_tail_];
-    ++awake_ring_tail_;
-    if (awake_ring_tail_ == awake_ring_size_)
-      awake_ring_tail_ = 0;
+  Fl_Awake_Node *t = awake_tail, *n = t->next;
+  if (!n) {
+    // Empty, so clear awake_pending and look once more: a message that
+    // was queued before that is seen now, one queued after it (or one
+    // whose producer has not linked it in yet) sends a new wake-up.
+    awake_pending = 0;
+    __sync_synchronize();
+    n = t->next;
+    if (!n) return -1;
   }
-  unlock_ring();
-  return ret;
+  __sync_synchronize();
+  func = n->func;
+  data = n->data;
+  awake_tail = n; // n becomes the stub
+  if (t != &awake_stub) free(t);
+  return 0;
 }
 
 //
@@ -128,9 +146,7 @@ int Fl::get_awake_handler_(Fl_Awake_Handler &func, void *&data)
   See void awake(void* message=0). 
 */
 int Fl::awake(Fl_Awake_Handler func, void *data) {
-  int ret = add_awake_handler_(func, data);
-  Fl::awake();
-  return ret;
+  return add_awake_handler_(func, data);
 }
 
 ////////////////////////////////////////////////////////////////
@@ -168,16 +184,18 @@ int Fl::awake(Fl_Awake_Handler func, void *data) {
     redraws can be processed.
     
     Multiple calls to Fl::awake() will queue multiple pointers 
-    for the main thread to process, up to a system-defined (typically several 
-    thousand) depth. The default message handler saves the last message which 
-    can be accessed using the 
+    for the main thread to process. The default message handler saves the
+    last message which can be accessed using the 
     Fl::thread_message() function.
     
     The second form of awake() registers a function that will be 
     called by the main thread during the next message handling cycle. 
     awake() will return 0 if the callback function was registered, 
-    and -1 if registration failed. Over a thousand awake callbacks can be
-    registered simultaneously.
+    and -1 if registration failed, which only happens when memory runs
+    out. There is no limit on the number of callbacks waiting to be
+    called, and they are called in the order they were registered. The
+    main thread is woken once for all the callbacks registered while it
+    was busy, and calls them all before it waits again.
 
     In the context of a threaded application, a call to Fl::awake() with no
     argument will trigger event loop handling in the main thread. Since
@@ -200,19 +218,6 @@ static DWORD main_thread;
 
 // Microsoft's version of a MUTEX...
 CRITICAL_SECTION cs;
-CRITICAL_SECTION *cs_ring;
-
-void unlock_ring() {
-  LeaveCriticalSection(cs_ring);
-}
-
-void lock_ring() {
-  if (!cs_ring) {
-    cs_ring = (CRITICAL_SECTION*)malloc(sizeof(CRITICAL_SECTION));
-    InitializeCriticalSection(cs_ring);
-  }
-  EnterCriticalSection(cs_ring);
-}
 
 //
 // 'unlock_function()' - Release the lock.
@@ -246,8 +251,16 @@ void Fl::unlock() {
   unlock_function();
 }
 
+// Messages go through the awake queue as entries without a function,
+// and the posted message only carries the wake-up
 void Fl::awake(void* msg) {
-  PostThreadMessage( main_thread, fl_wake_msg, (WPARAM)msg, 0);
+  add_awake_handler_(0, msg);
+}
+
+static void wake_main_thread() {
+  // If nobody can be woken yet, let the next message try again
+  if (!main_thread || !PostThreadMessage(main_thread, fl_wake_msg, 0, 0))
+    awake_pending = 0;
 }
 
 ////////////////////////////////////////////////////////////////
@@ -255,6 +268,7 @@ void Fl::awake(void* msg) {
 #elif HAVE_PTHREAD
 #  include <unistd.h>
 #  include <fcntl.h>
+#  include <errno.h>
 #  include <pthread.h>
 
 // Pipe for thread messaging via Fl::awake()...
@@ -303,8 +317,19 @@ static void unlock_function_rec() {
 }
 #  endif // PTHREAD_MUTEX_RECURSIVE
 
+// Messages go through the awake queue as entries without a function,
+// and the pipe only carries the wake-up
 void Fl::awake(void* msg) {
-  write(thread_filedes[1], &msg, sizeof(void*));
+  add_awake_handler_(0, msg);
+}
+
+static void wake_main_thread() {
+  char c = 0;
+  // A full pipe will wake the main thread anyway, but if nobody can be
+  // woken yet let the next message try again
+  if (!thread_filedes[1] ||
+      (write(thread_filedes[1], &c, 1) < 0 && errno != EAGAIN))
+    awake_pending = 0;
 }
 
 static void* thread_message_;
@@ -315,11 +340,13 @@ void* Fl::thread_message() {
 }
 
 static void thread_awake_cb(int fd, void*) {
-  read(fd, &thread_message_, sizeof(void*));
+  char buf[64];
+  while (read(fd, buf, sizeof(buf)) == (int)sizeof(buf)) {}
   Fl_Awake_Handler func;
   void *data;
   while (Fl::get_awake_handler_(func, data)==0) {
-    (*func)(data);
+    if (func) (*func)(data);
+    else thread_message_ = data;
   }
 }
 
@@ -334,9 +361,11 @@ void Fl::lock() {
     pipe(thread_filedes);
 
     // Make the write side of the pipe non-blocking to avoid deadlock
-    // conditions (STR #1537)
+    // conditions (STR #1537), and the read side so it can be emptied
     fcntl(thread_filedes[1], F_SETFL,
           fcntl(thread_filedes[1], F_GETFL) | O_NONBLOCK);
+    fcntl(thread_filedes[0], F_SETFL,
+          fcntl(thread_filedes[0], F_GETFL) | O_NONBLOCK);
 
     // Monitor the read side of the pipe so that messages sent via
     // Fl::awake() from a thread will "wake up" the main thread in
@@ -366,27 +395,9 @@ void Fl::unlock() {
   fl_unlock_function();
 }
 
-// Mutex code for the awake ring buffer
-static pthread_mutex_t *ring_mutex;
-
-void unlock_ring() {
-  pthread_mutex_unlock(ring_mutex);
-}
-
-void lock_ring() {
-  if (!ring_mutex) {
-    ring_mutex = (pthread_mutex_t*)malloc(sizeof(pthread_mutex_t));
-    pthread_mutex_init(ring_mutex, NULL);
-  }
-  pthread_mutex_lock(ring_mutex);
-}
-
 #else
 
-void unlock_ring() {
-}
-
-void lock_ring() {
+static void wake_main_thread() {
 }
 
 void Fl::awake(void*) {
@@ -415,21 +415,22 @@ int fl_wait(double time_to_wait) {
   have_message = PeekMessageW(&fl_msg, NULL, 0, 0, PM_REMOVE);
   if (have_message > 0) {
     while (have_message != 0 && have_message != -1) {
-      if (fl_msg.message == fl_wake_msg) {
-        // Used for awaking wait() from another thread
-	thread_message_ = (void*)fl_msg.wParam;
-        Fl_Awake_Handler func;
-        void *data;
-        while (Fl::get_awake_handler_(func, data)==0) {
-          func(data);
-        }
-      }
-
       TranslateMessage(&fl_msg);
       DispatchMessageW(&fl_msg);
       have_message = PeekMessageW(&fl_msg, NULL, 0, 0, PM_REMOVE);
     }
   }
+
+  // Run what other threads sent with Fl::awake().  fl_wake_msg only
+  // wakes us up, and a thread message is lost if a modal loop (a menu,
+  // a window being moved, a system dialog) takes it, so the queue is
+  // looked at on every pass rather than when the message is seen.
+  Fl_Awake_Handler func;
+  void *data;
+  while (Fl::get_awake_handler_(func, data)==0) {
+    if (func) func(data);
+    else thread_message_ = data;
+  }
   Fl::flush();
 
   // This should return 0 if only timer events were handled:
@@ -1093,6 +1094,14 @@ static LRESULT CALLBACK WndProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lPar
   case WM_MOUSEWHEEL: {
     static int delta = 0; // running total of all motion
     delta += (SHORT)(HIWORD(wParam));
+    // merge the wheel messages already queued for this window, as long
+    // as the modifier keys stay the same, into one FL_MOUSEWHEEL event
+    MSG next;
+    while (PeekMessageW(&next, hWnd, WM_MOUSEWHEEL, WM_MOUSEWHEEL, PM_NOREMOVE) &&
+           LOWORD(next.wParam) == LOWORD(wParam)) {
+      PeekMessageW(&next, hWnd, WM_MOUSEWHEEL, WM_MOUSEWHEEL, PM_REMOVE);
+      delta += (SHORT)(HIWORD(next.wParam));
+    }
     Fl::e_dy = -delta / WHEEL_DELTA;
     delta += Fl::e_dy * WHEEL_DELTA;
     if (Fl::e_dy) Fl::handle(FL_MOUSEWHEEL, window);
@@ -58,7 +58,185 @@ FL_EXPORT Fl_Graphics_Driver *fl_device = (Fl_Graphics_Driver*)&fl_xlib_driver;
 FL_EXPORT Fl_Surface_Device *fl_surface = (Fl_Surface_Device*)fl_display_device; // the current target surface of graphics operations
 
 ////////////////////////////////////////////////////////////////
-// interface to poll/select call:
+// interface to epoll/poll/select call:
+
+#  if USE_EPOLL
+
+#    include <sys/epoll.h>
+#    include <poll.h>
+#    include <errno.h>
+
+// Each descriptor is registered with the kernel once, when a callback is
+// added or removed, and epoll_wait() returns only the ready ones, so
+// waiting costs the same however many descriptors there are.  The
+// callbacks are found from a table indexed by the descriptor.  Kernels
+// built without epoll get a poll() set rebuilt from the same table
+// whenever it changes.
+
+static int epoll_fd = -1;
+static int epoll_failed = 0;	// epoll_create() failed, use poll()
+static int nfds = 0;	// number of callbacks
+struct FD {
+  short events;
+  void (*cb)(int, void*);
+  void* arg;
+  FD* next;		// next callback for the same descriptor
+};
+
+static FD **fd_table = 0;
+static int fd_table_size = 0;
+
+static pollfd *pollfds = 0;	// the poll() set, if epoll is unavailable
+static int npollfds = 0;
+static int pollfds_size = 0;
+static int pollfds_dirty = 0;	// fd_table changed since it was built
+
+static int epoll_init() {
+  if (epoll_fd < 0 && !epoll_failed) {
+#    ifdef EPOLL_CLOEXEC
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#    else
+    epoll_fd = epoll_create(64);
+#    endif
+    if (epoll_fd < 0) {
+      epoll_failed = 1;
+      Fl::warning("epoll_create: %s, using poll() instead", strerror(errno));
+    }
+  }
+  return epoll_fd;
+}
+
+// Rebuilds the poll() set from the callback table.
+static void build_pollfds() {
+  npollfds = 0;
+  for (int n = 0; n < fd_table_size; n++) {
+    if (!fd_table[n]) continue;
+    short e = 0;
+    for (FD* f = fd_table[n]; f; f = f->next) {
+      e |= f->events & (POLLIN|POLLOUT);
+      if (f->events & POLLERR) e |= POLLPRI; // like select()'s exceptfds
+    }
+    if (npollfds >= pollfds_size) {
+      int size = pollfds_size ? 2*pollfds_size : 16;
+      pollfd *temp = (pollfd*)realloc(pollfds, size*sizeof(pollfd));
+      if (!temp) break;
+      pollfds = temp;
+      pollfds_size = size;
+    }
+    pollfds[npollfds].fd = n;
+    pollfds[npollfds].events = e;
+    pollfds[npollfds].revents = 0;
+    npollfds++;
+  }
+  pollfds_dirty = 0;
+}
+
+// Tells the kernel which events the callbacks of descriptor n want.
+static void epoll_update(int n) {
+  if (epoll_init() < 0) {pollfds_dirty = 1; return;}
+  int e = 0;
+  for (FD* f = fd_table[n]; f; f = f->next) {
+    if (f->events & POLLIN) e |= EPOLLIN;
+    if (f->events & POLLOUT) e |= EPOLLOUT;
+    if (f->events & POLLERR) e |= EPOLLPRI; // like select()'s exceptfds
+  }
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = e;
+  ev.data.fd = n;
+  if (!fd_table[n]) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, n, &ev);
+  } else if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, n, &ev) < 0 && errno == ENOENT) {
+    // new, or closed and so dropped by the kernel since it was added
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, n, &ev);
+  }
+}
+
+void Fl::add_fd(int n, int events, void (*cb)(int, void*), void *v) {
+  remove_fd(n,events);
+  if (n < 0) return;
+  if (n >= fd_table_size) {
+    int size = fd_table_size ? fd_table_size : 64;
+    while (size <= n) size *= 2;
+    FD **temp = (FD**)realloc(fd_table, size*sizeof(FD*));
+    if (!temp) return;
+    memset(temp+fd_table_size, 0, (size-fd_table_size)*sizeof(FD*));
+    fd_table = temp;
+    fd_table_size = size;
+  }
+  FD* f = (FD*)malloc(sizeof(FD));
+  if (!f) return;
+  f->events = events;
+  f->cb = cb;
+  f->arg = v;
+  f->next = 0;
+  // keep the callbacks of a descriptor in the order they were added:
+  FD** p = &fd_table[n];
+  while (*p) p = &((*p)->next);
+  *p = f;
+  nfds++;
+  epoll_update(n);
+}
+
+void Fl::add_fd(int n, void (*cb)(int, void*), void* v) {
+  Fl::add_fd(n, POLLIN, cb, v);
+}
+
+void Fl::remove_fd(int n, int events) {
+  if (n < 0 || n >= fd_table_size || !fd_table[n]) return;
+  for (FD** p = &fd_table[n]; *p;) {
+    FD* f = *p;
+    int e = f->events & ~events;
+    if (!e) { // if no events left, delete this callback
+      *p = f->next;
+      free(f);
+      nfds--;
+      continue;
+    }
+    f->events = e;
+    p = &(f->next);
+  }
+  epoll_update(n);
+}
+
+// Calls the callbacks of a ready descriptor that want any of events.
+// Callbacks may add and remove callbacks, so each one is looked up
+// again before it is called.
+static void do_fd_events(int n, int events) {
+  for (int k = 0; ; ) {
+    if (n >= fd_table_size) return;
+    FD* f = fd_table[n];
+    int i = 0;
+    for (; f; f = f->next) if ((f->events & events) && i++ == k) break;
+    if (!f) return;
+    f->cb(n, f->arg);
+    // go on to the next one, unless this one removed itself
+    FD* g = n < fd_table_size ? fd_table[n] : 0;
+    while (g && g != f) g = g->next;
+    if (g && (g->events & events)) k++;
+  }
+}
+
+// Calls the callbacks of a descriptor epoll reported ready.
+static void do_fd_callbacks(int n, int revents) {
+  int events = 0;
+  if (revents & EPOLLIN) events |= POLLIN;
+  if (revents & EPOLLOUT) events |= POLLOUT;
+  if (revents & EPOLLPRI) events |= POLLERR;
+  // errors and hangups are for every callback to find out about:
+  if (revents & (EPOLLERR|EPOLLHUP)) events = POLLIN|POLLOUT|POLLERR;
+  do_fd_events(n, events);
+}
+
+// The same for a descriptor poll() reported ready.
+static void do_poll_callbacks(int n, int revents) {
+  int events = revents & (POLLIN|POLLOUT);
+  if (revents & POLLPRI) events |= POLLERR;
+  if (revents & (POLLERR|POLLHUP|POLLNVAL)) events = POLLIN|POLLOUT|POLLERR;
+  do_fd_events(n, events);
+}
+
+#  else
 
 #  if USE_POLL
 
@@ -173,13 +351,35 @@ void Fl::remove_fd(int n, int events) {
 #  endif
 }
 
+#  endif /* USE_EPOLL */
+
 void Fl::remove_fd(int n) {
   remove_fd(n, -1);
 }
 
+static int wheel_clicks = 1;	// size of the next FL_MOUSEWHEEL event
 #if CONSOLIDATE_MOTION
 static Fl_Window* send_motion;
 extern Fl_Window* fl_xmousewin;
+
+// Consecutive wheel clicks on the same window are merged into one
+// FL_MOUSEWHEEL event whose event_dy() is their sum:
+static XEvent wheel_event;	// the last merged wheel button press
+static int wheel_dy;		// sum of the merged clicks, 0 if none
+
+static int is_wheel(const XEvent& xevent) {
+  return (xevent.type == ButtonPress || xevent.type == ButtonRelease) &&
+         (xevent.xbutton.button == Button4 || xevent.xbutton.button == Button5);
+}
+
+static void send_wheel() {
+  if (!wheel_dy) return;
+  wheel_event.xbutton.button = wheel_dy < 0 ? Button4 : Button5;
+  wheel_clicks = wheel_dy < 0 ? -wheel_dy : wheel_dy;
+  wheel_dy = 0;
+  fl_handle(wheel_event);
+  wheel_clicks = 1;
+}
 #endif
 static bool in_a_window; // true if in any of our windows, even destroyed ones
 static void do_queued_events() {
@@ -187,14 +387,30 @@ static void do_queued_events() {
   while (XEventsQueued(fl_display,QueuedAfterReading)) {
     XEvent xevent;
     XNextEvent(fl_display, &xevent);
+#if CONSOLIDATE_MOTION
+    if (is_wheel(xevent)) {
+      if (wheel_dy && xevent.xany.window != wheel_event.xany.window)
+        send_wheel();
+      if (xevent.type == ButtonPress) {
+        wheel_event = xevent;
+        wheel_dy += xevent.xbutton.button == Button4 ? -1 : +1;
+      }
+      continue; // the releases do nothing but move the mouse
+    }
+    send_wheel();
+#endif
     fl_handle(xevent);
   }
+#if CONSOLIDATE_MOTION
+  send_wheel();
+#endif
   // we send FL_LEAVE only if the mouse did not enter some other window:
   if (!in_a_window) Fl::handle(FL_LEAVE, 0);
 #if CONSOLIDATE_MOTION
   else if (send_motion == fl_xmousewin) {
     send_motion = 0;
     Fl::handle(FL_MOVE, fl_xmousewin);
+    Fl::e_motion_n = 0;
   }
 #endif
 }
@@ -214,7 +430,9 @@ int fl_wait(double time_to_wait) {
   // so we must check for already-read events:
   if (fl_display && XQLength(fl_display)) {do_queued_events(); return 1;}
 
-#  if !USE_POLL
+#  if USE_EPOLL
+  struct epoll_event ev[64];
+#  elif !USE_POLL
   fd_set fdt[3];
   fdt[0] = fdsets[0];
   fdt[1] = fdsets[1];
@@ -224,6 +442,14 @@ int fl_wait(double time_to_wait) {
 
   fl_unlock_function();
 
+#  if USE_EPOLL
+  int ms = time_to_wait < 2147483.648 ? int(time_to_wait*1000 + .5) : -1;
+  if (epoll_init() >= 0) n = ::epoll_wait(epoll_fd, ev, 64, ms);
+  else {
+    if (pollfds_dirty) build_pollfds();
+    n = ::poll(pollfds, npollfds, ms);
+  }
+#  else
   if (time_to_wait < 2147483.648) {
 #  if USE_POLL
     n = ::poll(pollfds, nfds, int(time_to_wait*1000 + .5));
@@ -240,9 +466,19 @@ int fl_wait(double time_to_wait) {
     n = ::select(maxfd+1,&fdt[0],&fdt[1],&fdt[2],0);
 #  endif
   }
+#  endif /* USE_EPOLL */
 
   fl_lock_function();
 
+#  if USE_EPOLL
+  if (epoll_fd >= 0) {
+    for (int i=0; i<n; i++) do_fd_callbacks(ev[i].data.fd, ev[i].events);
+  } else if (n > 0) {
+    // callbacks only mark the set dirty, so it stays put while we look
+    for (int i=0; i<npollfds; i++)
+      if (pollfds[i].revents) do_poll_callbacks(pollfds[i].fd, pollfds[i].revents);
+  }
+#  else
   if (n > 0) {
     for (int i=0; i<nfds; i++) {
 #  if USE_POLL
@@ -257,6 +493,7 @@ int fl_wait(double time_to_wait) {
 #  endif
     }
   }
+#  endif /* USE_EPOLL */
   return n;
 }
 
@@ -264,7 +501,14 @@ int fl_wait(double time_to_wait) {
 int fl_ready() {
   if (XQLength(fl_display)) return 1;
   if (!nfds) return 0; // nothing to select or poll
-#  if USE_POLL
+#  if USE_EPOLL
+  if (epoll_fd < 0) {
+    if (pollfds_dirty) build_pollfds();
+    return ::poll(pollfds, npollfds, 0);
+  }
+  struct epoll_event ev;
+  return ::epoll_wait(epoll_fd, &ev, 1, 0);
+#  elif USE_POLL
   return ::poll(pollfds, nfds, 0);
 #  else
   timeval t;
@@ -1286,10 +1530,10 @@ int fl_handle(const XEvent& thisevent)
     Fl::e_keysym = FL_Button + xevent.xbutton.button;
     set_event_xy();
     if (xevent.xbutton.button == Button4) {
-      Fl::e_dy = -1; // Up
+      Fl::e_dy = -wheel_clicks; // Up
       event = FL_MOUSEWHEEL;
     } else if (xevent.xbutton.button == Button5) {
-      Fl::e_dy = +1; // Down
+      Fl::e_dy = +wheel_clicks; // Down
       event = FL_MOUSEWHEEL;
     } else {
       Fl::e_state |= (FL_BUTTON1 << (xevent.xbutton.button-1));
@@ -1302,12 +1546,25 @@ int fl_handle(const XEvent& thisevent)
     break;
 
   case MotionNotify:
-    set_event_xy();
 #  if CONSOLIDATE_MOTION
+    // start a new history unless this continues the pending motion:
+    if (send_motion != window) Fl::e_motion_n = 0;
+    set_event_xy();
+    if (Fl::e_motion_max) {
+      if (Fl::e_motion_n == Fl::e_motion_max) {
+        Fl::e_motion_n--;
+        memmove(Fl::e_motion_xy, Fl::e_motion_xy+2,
+                2*Fl::e_motion_n*sizeof(int));
+      }
+      Fl::e_motion_xy[2*Fl::e_motion_n]   = Fl::e_x;
+      Fl::e_motion_xy[2*Fl::e_motion_n+1] = Fl::e_y;
+      Fl::e_motion_n++;
+    }
     send_motion = fl_xmousewin = window;
     in_a_window = true;
     return 0;
 #  else
+    set_event_xy();
     event = FL_MOVE;
     fl_xmousewin = window;
     in_a_window = true;
@@ -117,9 +117,17 @@ int fl_filename_list(const char *d, dirent ***list,
     dirent *de = (*list)[i];
     int len = strlen(de->d_name);
     if (de->d_name[len-1]=='/' || len>FL_PATH_MAX) continue;
+#  ifdef DT_DIR
+    // Most file systems store the type in the directory entry, which saves
+    // a stat() per file in large directories. Links still have to be followed.
+    int isdir = de->d_type == DT_DIR;
+    if (!isdir && de->d_type != DT_UNKNOWN && de->d_type != DT_LNK) continue;
+#  else
+    int isdir = 0;
+#  endif
     // Use memcpy for speed since we already know the length of the string...
     memcpy(name, de->d_name, len+1);
-    if (fl_filename_isdir(fullname)) {
+    if (isdir || fl_filename_isdir(fullname)) {
       (*list)[i] = de = (dirent*)realloc(de, de->d_name - (char*)de + len + 2);
       char *dst = de->d_name + len;
       *dst++ = '/';
@@ -64,6 +64,7 @@
 #  include <FL/x.H>
 #  include "Fl_XColor.H"
 #  include "flstring.h"
+#  include "fl_simd.H"
 
 static XImage xi;	// template used to pass info to X
 static int bytes_per_pixel;
@@ -347,6 +348,27 @@ mono32_converter(const uchar *from,uchar *to,int w, int delta) {
     (*from << fl_redshift)+(*from << fl_greenshift)+(*from << fl_blueshift));
 }
 
+#  if FL_SIMD && !WORDS_BIGENDIAN
+// Vector versions of the common 32bit converters, chosen by
+// figure_out_visual() when the processor has them.  Each pattern gives
+// the source byte of every byte of the little-endian output word; the
+// end of the row is left to the plain converter.
+
+#    define SIMD_CONVERTER(name, b0, b1, b2, b3) \
+static void name##_simd(const uchar *from, uchar *to, int w, int delta) { \
+  static const signed char pattern[4] = {b0, b1, b2, b3}; \
+  int n = (delta > 0 && delta <= 4) ? fl_simd_shuffle32(from, to, w, delta, pattern) : 0; \
+  name(from + n*delta, to + 4*n, w - n, delta); \
+}
+
+SIMD_CONVERTER(xrgb_converter, 2, 1, 0, -1)
+SIMD_CONVERTER(xbgr_converter, 0, 1, 2, -1)
+SIMD_CONVERTER(rgbx_converter, -1, 2, 1, 0)
+SIMD_CONVERTER(bgrx_converter, -1, 0, 1, 2)
+SIMD_CONVERTER(xrrr_converter, 0, 0, 0, -1)
+SIMD_CONVERTER(rrrx_converter, -1, 0, 0, 0)
+#  endif
+
 ////////////////////////////////////////////////////////////////
 
 static void figure_out_visual() {
@@ -446,6 +468,16 @@ static void figure_out_visual() {
       converter = color32_converter;
       mono_converter = mono32_converter;
     }
+#  if FL_SIMD && !WORDS_BIGENDIAN
+    if (fl_simd_available()) {
+      if (converter == xrgb_converter) converter = xrgb_converter_simd;
+      else if (converter == xbgr_converter) converter = xbgr_converter_simd;
+      else if (converter == rgbx_converter) converter = rgbx_converter_simd;
+      else if (converter == bgrx_converter) converter = bgrx_converter_simd;
+      if (mono_converter == xrrr_converter) mono_converter = xrrr_converter_simd;
+      else if (mono_converter == rrrx_converter) mono_converter = rrrx_converter_simd;
+    }
+#  endif
     break;
 
   default:
@@ -456,6 +488,83 @@ static void figure_out_visual() {
 
 #  define MAXBUFFER 0x40000 // 256k
 
+#  if HAVE_XSHM
+#    include <sys/ipc.h>
+#    include <sys/shm.h>
+#    include <X11/extensions/XShm.h>
+
+// Large images are handed to a local server through shared memory, so
+// the pixels are not copied through the socket.  A few segments are kept
+// and reused round-robin; one is only written again once the server has
+// processed the XShmPutImage that last used it.  If the display has no
+// MIT-SHM, or the segment cannot be attached (a remote display), the
+// XPutImage code below is used instead.
+
+#    define SHM_POOL 2
+#    define SHM_MIN_SIZE 0x10000 // smaller images are cheaper to send
+
+struct Fl_Shm_Segment {
+  XShmSegmentInfo info;
+  long size;			// 0 if not attached
+  unsigned long serial;		// request that last read it
+};
+
+static Fl_Shm_Segment shm_pool[SHM_POOL];
+static int shm_next;
+static int shm_state;		// 0 = not checked, 1 = usable, -1 = unavailable
+static int shm_error;
+
+static int shm_error_handler(Display *, XErrorEvent *) {
+  shm_error = 1;
+  return 0;
+}
+
+// Returns a segment of at least size bytes that the server is no longer
+// reading from, or 0 if shared memory can't be used for this image.
+static Fl_Shm_Segment *shm_segment(long size) {
+  if (shm_state < 0 || size < SHM_MIN_SIZE) return 0;
+  if (!shm_state) {
+    shm_state = XShmQueryExtension(fl_display) ? 1 : -1;
+    if (shm_state < 0) return 0;
+  }
+  Fl_Shm_Segment *s = &shm_pool[shm_next];
+  shm_next = (shm_next + 1) % SHM_POOL;
+  if (s->size && (long)(LastKnownRequestProcessed(fl_display) - s->serial) < 0)
+    XSync(fl_display, False);
+  if (s->size >= size) return s;
+
+  if (s->size) {
+    XShmDetach(fl_display, &s->info);
+    shmdt(s->info.shmaddr);
+    s->size = 0;
+  }
+  int id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+  if (id < 0) return 0;
+  void *addr = shmat(id, 0, 0);
+  if (addr == (void *)-1) {
+    shmctl(id, IPC_RMID, 0);
+    return 0;
+  }
+  s->info.shmid = id;
+  s->info.shmaddr = (char *)addr;
+  s->info.readOnly = True;
+  shm_error = 0;
+  XErrorHandler old = XSetErrorHandler(shm_error_handler);
+  XShmAttach(fl_display, &s->info);
+  XSync(fl_display, False);
+  XSetErrorHandler(old);
+  // both sides are attached now, so the segment goes away with them
+  shmctl(id, IPC_RMID, 0);
+  if (shm_error) {
+    shmdt(addr);
+    shm_state = -1;
+    return 0;
+  }
+  s->size = size;
+  return s;
+}
+#  endif // HAVE_XSHM
+
 static void innards(const uchar *buf, int X, int Y, int W, int H,
 		    int delta, int linedelta, int mono,
 		    Fl_Draw_Image_Cb cb, void* userdata)
@@ -475,6 +584,35 @@ static void innards(const uchar *buf, int X, int Y, int W, int H,
   void (*conv)(const uchar *from, uchar *to, int w, int delta) = converter;
   if (mono) conv = mono_converter;
 
+#  if HAVE_XSHM
+  {
+    int linesize = (w*bytes_per_pixel+scanline_add)&scanline_mask;
+    Fl_Shm_Segment *s = shm_segment((long)linesize*h);
+    if (s) {
+      uchar *to = (uchar *)s->info.shmaddr;
+      if (buf) {
+	buf += delta*dx+linedelta*dy;
+	for (int j=0; j<h; j++, buf += linedelta, to += linesize)
+	  conv(buf, to, w, delta);
+      } else {
+	STORETYPE* linebuf = new STORETYPE[(W*delta+(sizeof(STORETYPE)-1))/sizeof(STORETYPE)];
+	for (int j=0; j<h; j++, to += linesize) {
+	  cb(userdata, dx, dy+j, w, (uchar*)linebuf);
+	  conv((uchar*)linebuf, to, w, delta);
+	}
+	delete[] linebuf;
+      }
+      xi.data = s->info.shmaddr;
+      xi.bytes_per_line = linesize;
+      xi.obdata = (char *)&s->info;
+      s->serial = NextRequest(fl_display);
+      XShmPutImage(fl_display, fl_window, fl_gc, &xi, 0, 0, X+dx, Y+dy, w, h, False);
+      xi.obdata = 0;
+      return;
+    }
+  }
+#  endif // HAVE_XSHM
+
   // See if the data is already in the right format.  Unfortunately
   // some 32-bit x servers (XFree86) care about the unknown 8 bits
   // and they must be zero.  I can't confirm this for user-supplied
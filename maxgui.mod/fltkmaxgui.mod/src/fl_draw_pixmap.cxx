@@ -27,10 +27,10 @@
 
 // Implemented without using the xpm library (which I can't use because
 // it interferes with the color cube used by fl_draw_image).
-// Current implementation is cheap and slow, and works best on a full-color
-// display.  Transparency is not handled, and colors are dithered to
-// the color cube.  Color index is achieved by adding the id
-// characters together!  Also mallocs a lot of temporary memory!
+// The data is parsed into RGBA pixels, which Fl_Pixmap keeps in a cache
+// shared by all pixmaps made from the same data (see Fl_Compiled_Pixmap.H),
+// so icons drawn over and over are only parsed once.  Colors are dithered
+// to the color cube on displays that need it.
 // Notice that there is no pixmap file interface.  This is on purpose,
 // as I want to discourage programs that require support files to work.
 // All data needed by a program ui should be compiled in!!!
@@ -40,6 +40,7 @@
 #include <FL/x.H>
 #include <stdio.h>
 #include "flstring.h"
+#include "Fl_Compiled_Pixmap.H"
 
 static int ncolors, chars_per_pixel;
 
@@ -67,135 +68,22 @@ int fl_measure_pixmap(const char * const *cdata, int &w, int &h) {
   return 1;
 }
 
-#ifdef U64
-
-// The callback from fl_draw_image to get a row of data passes this:
-struct pixmap_data {
-  int w, h;
-  const uchar*const* data;
-  union {
-    U64 colors[256];
-    U64* byte1[256];
-  };
-};
-
-// callback for 1 byte per pixel:
-static void cb1(void*v, int x, int y, int w, uchar* buf) {
-  pixmap_data& d = *(pixmap_data*)v;
-  const uchar* p = d.data[y]+x;
-  U64* q = (U64*)buf;
-  for (int X=w; X>0; X-=2, p += 2) {
-    if (X>1) {
-#  if WORDS_BIGENDIAN
-      *q++ = (d.colors[p[0]]<<32) | d.colors[p[1]];
-#  else
-      *q++ = (d.colors[p[1]]<<32) | d.colors[p[0]];
-#  endif
-    } else {
-#  if WORDS_BIGENDIAN
-      *q++ = d.colors[p[0]]<<32;
-#  else
-      *q++ = d.colors[p[0]];
-#  endif
-    }
-  }
-}
-
-// callback for 2 bytes per pixel:
-static void cb2(void*v, int x, int y, int w, uchar* buf) {
-  pixmap_data& d = *(pixmap_data*)v;
-  const uchar* p = d.data[y]+2*x;
-  U64* q = (U64*)buf;
-  for (int X=w; X>0; X-=2) {
-    U64* colors = d.byte1[*p++];
-    int index = *p++;
-    if (X>1) {
-      U64* colors1 = d.byte1[*p++];
-      int index1 = *p++;
-#  if WORDS_BIGENDIAN
-      *q++ = (colors[index]<<32) | colors1[index1];
-#  else
-      *q++ = (colors1[index1]<<32) | colors[index];
-#  endif
-    } else {
-#  if WORDS_BIGENDIAN
-      *q++ = colors[index]<<32;
-#  else
-      *q++ = colors[index];
-#  endif
-    }
-  }
-}
-
-#else // U32
-
-// The callback from fl_draw_image to get a row of data passes this:
-struct pixmap_data {
-  int w, h;
-  const uchar*const* data;
-  union {
-    U32 colors[256];
-    U32* byte1[256];
-  };
-};
-
-// callback for 1 byte per pixel:
-static void cb1(void*v, int x, int y, int w, uchar* buf) {
-  pixmap_data& d = *(pixmap_data*)v;
-  const uchar* p = d.data[y]+x;
-  U32* q = (U32*)buf;
-  for (int X=w; X--;) *q++ = d.colors[*p++];
-}
-
-// callback for 2 bytes per pixel:
-static void cb2(void*v, int x, int y, int w, uchar* buf) {
-  pixmap_data& d = *(pixmap_data*)v;
-  const uchar* p = d.data[y]+2*x;
-  U32* q = (U32*)buf;
-  for (int X=w; X--;) {
-    U32* colors = d.byte1[*p++];
-    *q++ = colors[*p++];
-  }
-}
-
-#endif // U64 else U32
 
 uchar **fl_mask_bitmap; // if non-zero, create bitmap and store pointer here
 
-/**
-  Draw XPM image data, with the top-left corner at the given position.
-  The image is dithered on 8-bit displays so you won't lose color
-  space for programs displaying both images and pixmaps.
-  \param[in] data pointer to XPM image data
-  \param[in] x,y  position of top-left corner
-  \param[in] bg   background color
-  \returns 0 if there was any error decoding the XPM data.
-  */
-int fl_draw_pixmap(/*const*/ char* const* data, int x,int y,Fl_Color bg) {
-  return fl_draw_pixmap((const char*const*)data,x,y,bg);
-}
-
 #ifdef WIN32
-// to compute an unused color to be used for the pixmap background
 FL_EXPORT UINT win_pixmap_bg_color; // the RGB() of the pixmap background color
-static int color_count; // # of non-transparent colors used in pixmap
-static uchar *used_colors; // used_colors[3*i+j] j=0,1,2 are the RGB values of the ith used color
 
-static void make_unused_color(uchar &r, uchar &g, uchar &b)
-// makes an RGB triplet different from all the colors used in the pixmap
-// and compute win_pixmap_bg_color from this triplet
+// Returns an RGB() that is none of the n colors in used, so that a
+// printer can be told to leave the pixels of that color out.
+static UINT make_unused_color(const uchar *used, int n)
 {
-  int i;
-  r = 2; g = 3; b = 4;
-  while (1) {
-    for ( i = 0; i < color_count; i++) {
-      if(used_colors[3*i] == r && used_colors[3*i+1] == g && used_colors[3*i+2] == b) break;
-      }
-    if (i >= color_count) {
-      free(used_colors);
-      win_pixmap_bg_color = RGB(r, g, b);
-      return;
-      }
+  uchar r = 2, g = 3, b = 4;
+  for (;;) {
+    int i;
+    for (i = 0; i < n; i++)
+      if (used[3*i] == r && used[3*i+1] == g && used[3*i+2] == b) break;
+    if (i >= n) return RGB(r, g, b);
     if (r < 255) r++;
     else {
       r = 0;
@@ -203,224 +91,257 @@ static void make_unused_color(uchar &r, uchar &g, uchar &b)
       else {
 	g = 0;
 	b++;
-	}
       }
     }
+  }
 }
 #endif
 
-/**
-  Draw XPM image data, with the top-left corner at the given position.
-  \see fl_draw_pixmap(char* const* data, int x, int y, Fl_Color bg)
-  */
-int fl_draw_pixmap(const char*const* cdata, int x, int y, Fl_Color bg) {
-  pixmap_data d;
-  if (!fl_measure_pixmap(cdata, d.w, d.h)) return 0;
+// Parses the colormap and pixels of an XPM image into p->rgba.  Returns 0
+// if the data could not be parsed.
+static int parse_pixmap(const char * const *cdata, Fl_Compiled_Pixmap *p) {
+  if (!fl_measure_pixmap(cdata, p->w, p->h)) return 0;
   const uchar*const* data = (const uchar*const*)(cdata+1);
-  int transparent_index = -1;
-  uchar *transparent_c = (uchar *)0; // such that transparent_c[0,1,2] are the RGB of the transparent color
+  int cpp = chars_per_pixel;
+  // the color of a pixel is colors[c] for one character per pixel,
+  // byte1[c1][c2] for two.  Unknown characters are transparent.
+  static const uchar none[4] = {0, 0, 0, 0};
+  uchar colors[256][4];
+  uchar (*byte1[256])[4];
+  memset(colors, 0, sizeof(colors));
+  memset(byte1, 0, sizeof(byte1));
+  int transparent = 0;
 #ifdef WIN32
-  color_count = 0;
-  used_colors = (uchar *)malloc(abs(ncolors)*3*sizeof(uchar));
+  uchar *used = new uchar[3*(ncolors < 0 ? -ncolors : ncolors) + 3];
+  int nused = 0;
 #endif
 
   if (ncolors < 0) {	// FLTK (non standard) compressed colormap
-    ncolors = -ncolors;
-    const uchar *p = *data++;
+    int n = -ncolors;
+    const uchar *q = *data++;
     // if first color is ' ' it is transparent (put it later to make
     // it not be transparent):
-    if (*p == ' ') {
-      uchar* c = (uchar*)&d.colors[(int)' '];
-#ifdef U64
-      *(U64*)c = 0;
-#  if WORDS_BIGENDIAN
-      c += 4;
-#  endif
-#endif
-      transparent_index = ' ';
-      Fl::get_color(bg, c[0], c[1], c[2]); c[3] = 0;
-      transparent_c = c;
-      p += 4;
-      ncolors--;
+    if (*q == ' ') {
+      transparent = 1;
+      q += 4;
+      n--;
     }
     // read all the rest of the colors:
-    for (int i=0; i < ncolors; i++) {
-      uchar* c = (uchar*)&d.colors[*p++];
-#ifdef U64
-      *(U64*)c = 0;
-#  if WORDS_BIGENDIAN
-      c += 4;
-#  endif
-#endif
+    for (int i = 0; i < n; i++) {
+      uchar *c = colors[*q++];
 #ifdef WIN32
-      used_colors[3*color_count] = *p;
-      used_colors[3*color_count+1] = *(p+1);
-      used_colors[3*color_count+2] = *(p+2);
-      color_count++;
+      memcpy(used + 3*nused++, q, 3);
 #endif
-      *c++ = *p++;
-      *c++ = *p++;
-      *c++ = *p++;
-#ifdef __APPLE_QUARTZ__
+      *c++ = *q++;
+      *c++ = *q++;
+      *c++ = *q++;
       *c = 255;
-#else
-      *c = 0;
-#endif
     }
   } else {	// normal XPM colormap with names
-    if (chars_per_pixel>1) memset(d.byte1, 0, sizeof(d.byte1));
-    for (int i=0; i<ncolors; i++) {
-      const uchar *p = *data++;
+    for (int i = 0; i < ncolors; i++) {
+      const uchar *q = *data++;
       // the first 1 or 2 characters are the color index:
-      int ind = *p++;
-      uchar* c;
-      if (chars_per_pixel>1) {
-#ifdef U64
-	U64* colors = d.byte1[ind];
-	if (!colors) colors = d.byte1[ind] = new U64[256];
-#else
-	U32* colors = d.byte1[ind];
-	if (!colors) colors = d.byte1[ind] = new U32[256];
-#endif
-	c = (uchar*)&colors[*p];
-	ind = (ind<<8)|*p++;
+      uchar *c;
+      if (cpp > 1) {
+	int ind = *q++;
+	if (!byte1[ind]) {
+	  byte1[ind] = new uchar[256][4];
+	  memset(byte1[ind], 0, 256*4);
+	}
+	c = byte1[ind][*q++];
       } else {
-	c = (uchar *)&d.colors[ind];
+	c = colors[*q++];
       }
       // look for "c word", or last word if none:
-      const uchar *previous_word = p;
+      const uchar *previous_word = q;
       for (;;) {
-	while (*p && isspace(*p)) p++;
-	uchar what = *p++;
-	while (*p && !isspace(*p)) p++;
-	while (*p && isspace(*p)) p++;
-	if (!*p) {p = previous_word; break;}
+	while (*q && isspace(*q)) q++;
+	uchar what = *q++;
+	while (*q && !isspace(*q)) q++;
+	while (*q && isspace(*q)) q++;
+	if (!*q) {q = previous_word; break;}
 	if (what == 'c') break;
-	previous_word = p;
-	while (*p && !isspace(*p)) p++;
+	previous_word = q;
+	while (*q && !isspace(*q)) q++;
       }
-#ifdef U64
-      *(U64*)c = 0;
-#  if WORDS_BIGENDIAN
-      c += 4;
-#  endif
-#endif
-#ifdef __APPLE_QUARTZ__
-      c[3] = 255;
-#endif
-      int parse = fl_parse_color((const char*)p, c[0], c[1], c[2]);
-      if (parse) {
+      if (fl_parse_color((const char*)q, c[0], c[1], c[2])) {
+	c[3] = 255;
 #ifdef WIN32
-	used_colors[3*color_count] = c[0];
-	used_colors[3*color_count+1] = c[1];
-	used_colors[3*color_count+2] = c[2];
-	color_count++;
+	memcpy(used + 3*nused++, c, 3);
 #endif
-	}
-      else {
-        // assume "None" or "#transparent" for any errors
-	// "bg" should be transparent...
-	Fl::get_color(bg, c[0], c[1], c[2]);
-#ifdef __APPLE_QUARTZ__
-        c[3] = 0;
-#endif
-	transparent_index = ind;
-	transparent_c = c;
+      } else {
+	// assume "None" or "#transparent" for any errors
+	c[0] = c[1] = c[2] = c[3] = 0;
+	transparent = 1;
+      }
+    }
+  }
+
+  uchar *out = p->rgba = new uchar[p->w * p->h * 4];
+  for (int Y = 0; Y < p->h; Y++) {
+    const uchar *q = data[Y];
+    if (cpp <= 1) {
+      for (int X = 0; X < p->w; X++, out += 4) memcpy(out, colors[*q++], 4);
+    } else {
+      for (int X = 0; X < p->w; X++, out += 4, q += 2) {
+	uchar (*c)[4] = byte1[q[0]];
+	memcpy(out, c ? c[q[1]] : none, 4);
       }
     }
   }
-  d.data = data;
+  p->transparent = transparent;
+
+  for (int i = 0; i < 256; i++) delete[] byte1[i];
 #ifdef WIN32
-  if (transparent_c) {
-    make_unused_color(transparent_c[0], transparent_c[1], transparent_c[2]);
+  p->bg = make_unused_color(used, nused);
+  delete[] used;
+#endif
+  return 1;
+}
+
+// All the compiled pixmaps held by an Fl_Pixmap, hashed by data address:
+static Fl_Compiled_Pixmap *compiled[256];
+
+static unsigned hash_data(const char * const *data) {
+  size_t a = (size_t)data;
+  return (unsigned)((a >> 4) ^ (a >> 12)) & 255;
+}
+
+Fl_Compiled_Pixmap *fl_find_compiled_pixmap(const char * const *data) {
+  for (Fl_Compiled_Pixmap *p = compiled[hash_data(data)]; p; p = p->next)
+    if (p->data == data) return p;
+  return 0;
+}
+
+Fl_Compiled_Pixmap *fl_compile_pixmap(const char * const *data) {
+  if (!data) return 0;
+  Fl_Compiled_Pixmap *p = fl_find_compiled_pixmap(data);
+  if (p) {
+    p->refs++;
+    return p;
   }
-  else {
-    uchar r, g, b;
-    make_unused_color(r, g, b);
+  p = new Fl_Compiled_Pixmap;
+  memset(p, 0, sizeof(*p));
+  if (!parse_pixmap(data, p)) {
+    delete p;
+    return 0;
   }
-#endif
-  
+  p->data = data;
+  p->refs = 1;
+  unsigned h = hash_data(data);
+  p->next = compiled[h];
+  compiled[h] = p;
+  return p;
+}
+
+void fl_release_compiled_pixmap(Fl_Compiled_Pixmap *p) {
+  if (--p->refs > 0) return;
+  Fl_Compiled_Pixmap **pp = &compiled[hash_data(p->data)];
+  while (*pp != p) pp = &(*pp)->next;
+  *pp = p->next;
+  delete p->image;	// which frees its server copy
+  if (p->id) fl_delete_offscreen(p->id);
+  if (p->mask) fl_delete_bitmask(p->mask);
+  delete[] p->rgba;
+  delete p;
+}
+
+struct pixmap_data {
+  const Fl_Compiled_Pixmap *p;
+  uchar bg[3];
+};
+
+// Converts RGBA pixels to RGB, transparent pixels to the background color.
+static void cb(void*v, int x, int y, int w, uchar* buf) {
+  pixmap_data& d = *(pixmap_data*)v;
+  const uchar* p = d.p->rgba + (y*d.p->w + x)*4;
+  for (int X = w; X--; p += 4, buf += 3) {
+    if (p[3]) {buf[0] = p[0]; buf[1] = p[1]; buf[2] = p[2];}
+    else {buf[0] = d.bg[0]; buf[1] = d.bg[1]; buf[2] = d.bg[2];}
+  }
+}
+
+/**
+  Draw XPM image data, with the top-left corner at the given position.
+  The image is dithered on 8-bit displays so you won't lose color
+  space for programs displaying both images and pixmaps.
+  \param[in] data pointer to XPM image data
+  \param[in] x,y  position of top-left corner
+  \param[in] bg   background color
+  \returns 0 if there was any error decoding the XPM data.
+  */
+int fl_draw_pixmap(/*const*/ char* const* data, int x,int y,Fl_Color bg) {
+  return fl_draw_pixmap((const char*const*)data,x,y,bg);
+}
+
+/**
+  Draw XPM image data, with the top-left corner at the given position.
+  \see fl_draw_pixmap(char* const* data, int x, int y, Fl_Color bg)
+  */
+int fl_draw_pixmap(const char*const* cdata, int x, int y, Fl_Color bg) {
+  // use the parsed pixels of an Fl_Pixmap drawing the same data, or
+  // parse them just for this call
+  Fl_Compiled_Pixmap tmp, *p = fl_find_compiled_pixmap(cdata);
+  if (!p) {
+    p = &tmp;
+    memset(p, 0, sizeof(tmp));
+    if (!parse_pixmap(cdata, p)) return 0;
+  }
+
 #ifdef  __APPLE_QUARTZ__
   if (fl_device->type() == Fl_Quartz_Graphics_Driver::device_type ) {
-    bool transparent = (transparent_index>=0);
-    transparent = true;
-    U32 *array = new U32[d.w * d.h], *q = array;
-    for (int Y = 0; Y < d.h; Y++) {
-      const uchar* p = data[Y];
-      if (chars_per_pixel <= 1) {
-	for (int X = 0; X < d.w; X++) {
-	  *q++ = d.colors[*p++];
-	}
-      } else {
-	for (int X = 0; X < d.w; X++) {
-	  U32* colors = (U32*)d.byte1[*p++];
-	  *q++ = colors[*p++];
-	}
-      }
-    }
     CGColorSpaceRef lut = CGColorSpaceCreateDeviceRGB();
-    CGDataProviderRef src = CGDataProviderCreateWithData( 0L, array, d.w * d.h * 4, 0L);
-    CGImageRef img = CGImageCreate(d.w, d.h, 8, 4*8, 4*d.w,
-				   lut, transparent?kCGImageAlphaLast:kCGImageAlphaNoneSkipLast,
+    CGDataProviderRef src = CGDataProviderCreateWithData( 0L, p->rgba, p->w * p->h * 4, 0L);
+    CGImageRef img = CGImageCreate(p->w, p->h, 8, 4*8, 4*p->w,
+				   lut, kCGImageAlphaLast,
 				   src, 0L, false, kCGRenderingIntentDefault);
     CGColorSpaceRelease(lut);
     CGDataProviderRelease(src);
-    CGRect rect = { { x, y} , { d.w, d.h } };
-    Fl_X::q_begin_image(rect, 0, 0, d.w, d.h);
+    CGRect rect = { { x, y} , { p->w, p->h } };
+    Fl_X::q_begin_image(rect, 0, 0, p->w, p->h);
     CGContextDrawImage(fl_gc, rect, img);
     Fl_X::q_end_image();
     CGImageRelease(img);
-    delete array;
     }
   else {
 #endif // __APPLE_QUARTZ__
 
   // build the mask bitmap used by Fl_Pixmap:
-  if (fl_mask_bitmap && transparent_index >= 0) {
-    int W = (d.w+7)/8;
-    uchar* bitmap = new uchar[W * d.h];
+  if (fl_mask_bitmap && p->transparent) {
+    int W = (p->w+7)/8;
+    uchar* bitmap = new uchar[W * p->h];
     *fl_mask_bitmap = bitmap;
-    for (int Y = 0; Y < d.h; Y++) {
-      const uchar* p = data[Y];
-      if (chars_per_pixel <= 1) {
-	int dw = d.w;
-	for (int X = 0; X < W; X++) {
-	  uchar b = (dw-->0 && *p++ != transparent_index);
-	  if (dw-->0 && *p++ != transparent_index) b |= 2;
-	  if (dw-->0 && *p++ != transparent_index) b |= 4;
-	  if (dw-->0 && *p++ != transparent_index) b |= 8;
-	  if (dw-->0 && *p++ != transparent_index) b |= 16;
-	  if (dw-->0 && *p++ != transparent_index) b |= 32;
-	  if (dw-->0 && *p++ != transparent_index) b |= 64;
-	  if (dw-->0 && *p++ != transparent_index) b |= 128;
+    const uchar *a = p->rgba + 3;
+    for (int Y = 0; Y < p->h; Y++) {
+      uchar b = 0, bit = 1;
+      for (int X = 0; X < p->w; X++, a += 4) {
+	if (*a) b |= bit;
+	if (bit < 128) bit <<= 1;
+	else {
 	  *bitmap++ = b;
+	  b = 0;
+	  bit = 1;
 	}
-      } else {
-        uchar b = 0, bit = 1;
-	for (int X = 0; X < d.w; X++) {
-	  int ind = *p++;
-	  ind = (ind<<8) | (*p++);
-	  if (ind != transparent_index) b |= bit;
-
-          if (bit < 128) bit <<= 1;
-	  else {
-	    *bitmap++ = b;
-	    b = 0;
-	    bit = 1;
-	  }
-	}
-
-        if (bit > 1) *bitmap++ = b;
       }
+      if (bit > 1) *bitmap++ = b;
     }
   }
 
-  fl_draw_image(chars_per_pixel==1 ? cb1 : cb2, &d, x, y, d.w, d.h, 4);
+  pixmap_data d;
+  d.p = p;
+#ifdef WIN32
+  // transparent pixels get a color used nowhere else, for printing
+  win_pixmap_bg_color = p->bg;
+  d.bg[0] = GetRValue(p->bg); d.bg[1] = GetGValue(p->bg); d.bg[2] = GetBValue(p->bg);
+#else
+  Fl::get_color(bg, d.bg[0], d.bg[1], d.bg[2]);
+#endif
+  fl_draw_image(cb, &d, x, y, p->w, p->h, 3);
 #ifdef __APPLE_QUARTZ__
     }
 #endif
 
-  if (chars_per_pixel > 1) for (int i = 0; i < 256; i++) delete[] d.byte1[i];
+  if (p == &tmp) delete[] tmp.rgba;
   return 1;
 }
 
@@ -81,6 +81,13 @@ void fl_text_extents(const char *c, int &dx, int &dy, int &w, int &h) {
 } // fl_text_extents
 
 
+#if defined(WIN32) || defined(__APPLE__) || !USE_XFT
+// only the Xft fl_width() caches advances
+void fl_width_cache_stats(unsigned long& hits, unsigned long& misses) {
+  hits = misses = 0;
+}
+#endif
+
 #if !USE_XFT && !__APPLE__
 void fl_draw(const char* str, int l, float x, float y) {
   fl_draw(str, l, (int)x, (int)y);
@@ -317,11 +317,18 @@ Fl_Font_Descriptor::Fl_Font_Descriptor(const char* name) {
 #if HAVE_GL
   listbase = 0;
 #endif // HAVE_GL
+  width_latin = 0;
+  width_keys = 0;
+  width_values = 0;
+  width_count = width_size = 0;
   font = fontopen(name, false, angle);
 }
 
 Fl_Font_Descriptor::~Fl_Font_Descriptor() {
   if (this == fl_fontsize) fl_fontsize = 0;
+  free(width_latin);
+  free(width_keys);
+  free(width_values);
 //  XftFontClose(fl_display, font);
 }
 
@@ -335,11 +342,108 @@ int fl_descent() {
   else return -1;
 }
 
+// Asking Xft for the extents of a string is a round trip through the
+// glyph cache of the library for every call, and fl_width() is called
+// for every character by the text widgets. Xft does not kern, so the
+// width of a string is just the sum of the advances of its characters,
+// which are kept for each font: in a table for Latin-1 and in a hash
+// table for everything else.
+
+#define WIDTH_UNKNOWN (-32768)
+
+// characters measured by fl_width() from the advance cache and through Xft
+static unsigned long fl_width_cache_hits = 0;
+static unsigned long fl_width_cache_misses = 0;
+
+void fl_width_cache_stats(unsigned long& hits, unsigned long& misses) {
+  hits = fl_width_cache_hits;
+  misses = fl_width_cache_misses;
+}
+
+static inline unsigned width_hash(unsigned ucs, int size) {
+  return (ucs * 2654435761U) & (size - 1);
+}
+
+static void store_width(Fl_Font_Descriptor *f, unsigned ucs, int w) {
+  if (ucs < 256) {
+    f->width_latin[ucs] = w;
+    return;
+  }
+  if (2 * (f->width_count + 1) > f->width_size) {
+    int oldsize = f->width_size;
+    unsigned *oldkeys = f->width_keys;
+    short *oldvalues = f->width_values;
+    f->width_size = oldsize ? 2 * oldsize : 256;
+    f->width_keys = (unsigned *)calloc(f->width_size, sizeof(unsigned));
+    f->width_values = (short *)malloc(f->width_size * sizeof(short));
+    f->width_count = 0;
+    for (int i = 0; i < oldsize; i++)
+      if (oldkeys[i]) store_width(f, oldkeys[i], oldvalues[i]);
+    free(oldkeys);
+    free(oldvalues);
+  }
+  unsigned i = width_hash(ucs, f->width_size);
+  while (f->width_keys[i] && f->width_keys[i] != ucs)
+    i = (i + 1) & (f->width_size - 1);
+  if (!f->width_keys[i]) f->width_count++;
+  f->width_keys[i] = ucs;
+  f->width_values[i] = w;
+}
+
+// Returns the advance of character ucs in font f, measuring it the
+// first time it is asked for.
+static int char_width(Fl_Font_Descriptor *f, unsigned ucs) {
+  int w = WIDTH_UNKNOWN;
+  if (ucs < 256) {
+    if (!f->width_latin) {
+      f->width_latin = (short *)malloc(256 * sizeof(short));
+      for (int i = 0; i < 256; i++) f->width_latin[i] = WIDTH_UNKNOWN;
+    }
+    w = f->width_latin[ucs];
+  } else if (f->width_size) {
+    unsigned i = width_hash(ucs, f->width_size);
+    while (f->width_keys[i]) {
+      if (f->width_keys[i] == ucs) {
+        w = f->width_values[i];
+        break;
+      }
+      i = (i + 1) & (f->width_size - 1);
+    }
+  }
+  if (w != WIDTH_UNKNOWN) {
+    fl_width_cache_hits++;
+    return w;
+  }
+  fl_width_cache_misses++;
+  XGlyphInfo gi;
+  FcChar32 c = ucs;
+  XftTextExtents32(fl_display, f->font, &c, 1, &gi);
+  store_width(f, ucs, gi.xOff);
+  return gi.xOff;
+}
+
 double fl_width(const char *str, int n) {
   if (!current_font) return -1.0;
-  XGlyphInfo i;
-  XftTextExtentsUtf8(fl_display, current_font, (XftChar8 *)str, n, &i);
-  return i.xOff;
+  const char *p = str, *end = str + n;
+  int w = 0;
+  while (p < end) {
+    unsigned ucs;
+    int len;
+    if (!(*p & 0x80)) {
+      ucs = *p;
+      len = 1;
+    } else {
+      ucs = fl_utf8decode(p, end, &len);
+      if (len < 2) { // not UTF-8, leave it to Xft
+        XGlyphInfo i;
+        XftTextExtentsUtf8(fl_display, current_font, (XftChar8 *)str, n, &i);
+        return i.xOff;
+      }
+    }
+    w += char_width(fl_fontsize, ucs);
+    p += len;
+  }
+  return w;
 }
 
 double fl_width(uchar c) {
@@ -348,9 +452,10 @@ double fl_width(uchar c) {
 
 double fl_width(FcChar32 *str, int n) {
   if (!current_font) return -1.0;
-  XGlyphInfo i;
-  XftTextExtents32(fl_display, current_font, str, n, &i);
-  return i.xOff;
+  int w = 0;
+  for (int i = 0; i < n; i++)
+    w += char_width(fl_fontsize, str[i]);
+  return w;
 }
 
 double fl_width(unsigned int c) {